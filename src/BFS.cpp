@@ -36,20 +36,42 @@
 
 #ifndef __PROGTEST__
 #include <cassert>
+#include <chrono>
+#include <coroutine>
+#include <cmath>
 #include <cstdarg>
 #include <iomanip>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <limits>
 #include <optional>
 #include <array>
 #include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <bit>
 #include <vector>
 #include <deque>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <cstring>
+#include <system_error>
+#include <filesystem>
 #include <queue>
 #include <random>
+#include <span>
+#include <thread>
 #include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
 
 
 struct TestFailed : std::runtime_error {
@@ -82,96 +104,286 @@ enum Vertex : size_t {
 
 enum : size_t { NO_DISTANCE = -size_t(1) };
 
-struct Graph {
-  Graph() : Graph(false, 0) {}
-  Graph(bool directed, size_t vertices) : _dir(directed), _adj(vertices) {}
-  Graph(bool directed, const std::vector<std::vector<size_t>>& adj)
-    : Graph(directed, adj.size()) {
+// Half-width vertex IDs for graphs below 2^32 - 2 vertices. Predecessor and
+// distance arrays over them take half the memory.
+enum Vertex32 : uint32_t {};
+
+template<typename V>
+struct BasicVertexIterator {
+  BasicVertexIterator() = default;
+  BasicVertexIterator(size_t v) : _v(v) {}
+
+  BasicVertexIterator& operator ++ () { _v++; return *this; }
+  V operator * () const { return V(_v); }
+
+  friend bool operator == (BasicVertexIterator a, BasicVertexIterator b) { return a._v == b._v; }
+  friend bool operator != (BasicVertexIterator a, BasicVertexIterator b) { return !(a == b); }
+
+  private:
+  size_t _v = NO_VERTEX;
+};
+
+using VertexIterator = BasicVertexIterator<Vertex>;
+
+// Checking policies of BasicGraph::operator []. CheckedAccess is what the
+// tests run with: bounds checks and, between bfs_debug_begin() and
+// bfs_debug_end(), detection of adjacency lists examined a second time.
+// UncheckedAccess compiles to nothing, leaving operator [] a plain lookup;
+// it is what Graph means in NDEBUG builds.
+struct CheckedAccess {
+  void access(size_t v, size_t vertices) const {
+    CHECK(v < vertices, "Graph: index %zu out of range [0..%zu).", v, vertices);
+
+    if (!_seen.empty()) {
+      CHECK(!_seen[v], "Graph: vertex %zu examined second time", v);
+      _seen[v] = true;
+    }
+  }
+
+  void debug_begin(size_t vertices) const { _seen.assign(vertices, false); }
+  void debug_end() const { _seen.assign(0, false); }
+
+  private:
+  mutable std::vector<bool> _seen;
+};
+
+struct UncheckedAccess {
+  void access(size_t, size_t) const {}
+  void debug_begin(size_t) const {}
+  void debug_end() const {}
+};
+
+// Lazily built transpose of a graph, see BasicGraph::transposed. Copies of
+// the graph share a transpose that is already built.
+template<typename GraphT>
+struct TransposeCache {
+  TransposeCache() = default;
+  TransposeCache(const TransposeCache& o) : _graph(o.get()) {}
+  TransposeCache& operator = (const TransposeCache& o) {
+    auto graph = o.get();
+    std::lock_guard guard(_lock);
+    _graph = std::move(graph);
+    return *this;
+  }
+
+  std::shared_ptr<const GraphT> get() const {
+    std::lock_guard guard(_lock);
+    return _graph;
+  }
+
+  template<typename Build>
+  const GraphT& get_or_build(Build build) const {
+    std::lock_guard guard(_lock);
+    if (!_graph) _graph = std::make_shared<const GraphT>(build());
+    return *_graph;
+  }
+
+  // Like any change of the graph, needs exclusive access.
+  void reset() { _graph.reset(); }
+
+  private:
+  mutable std::mutex _lock;
+  mutable std::shared_ptr<const GraphT> _graph;
+};
+
+template<typename Checks, typename V = Vertex>
+struct BasicGraph {
+  using vertex_type = V;
+
+  BasicGraph() : BasicGraph(false, 0) {}
+  BasicGraph(bool directed, size_t vertices) : _dir(directed), _adj(vertices) {}
+  BasicGraph(bool directed, const std::vector<std::vector<size_t>>& adj)
+    : BasicGraph(directed, adj.size()) {
     for (size_t i = 0; i < adj.size(); i++)
-      for (size_t v : adj[i]) add_edge(Vertex{i}, Vertex{v});
+      for (size_t v : adj[i]) add_edge(V(i), V(v));
+  }
+
+  // Frozen graph over ready CSR arrays, targets[offsets[v]..offsets[v+1]) are
+  // the neighbors of v. Undirected graphs must list both directions.
+  static BasicGraph from_csr(bool directed, std::vector<size_t> offsets,
+                        std::vector<V> targets) {
+    auto csr = std::make_shared<const Csr>(Csr{ std::move(offsets), std::move(targets) });
+    return from_view(directed, csr->offsets, csr->targets, csr);
+  }
+
+  // Frozen graph over CSR arrays owned by someone else, e.g. a mapped file.
+  // The graph and its copies keep `owner` alive.
+  static BasicGraph from_view(bool directed, std::span<const size_t> offsets,
+                         std::span<const V> targets,
+                         std::shared_ptr<const void> owner) {
+    CHECK(!offsets.empty() && offsets.back() == targets.size(),
+      "Graph: CSR offsets do not match %zu targets.", targets.size());
+
+    BasicGraph ret(directed, 0);
+    ret._storage = std::move(owner);
+    ret._offsets = offsets;
+    ret._targets = targets;
+    return ret;
   }
 
   bool is_directed() const { return _dir; }
-  size_t vertices() const { return _adj.size(); }
+  size_t vertices() const { return _storage ? _offsets.size() - 1 : _adj.size(); }
+  size_t edges() const { return _storage ? _targets.size() : count_edges(); }
+  bool is_frozen() const { return _storage != nullptr; }
+
+  // Raw CSR arrays of a frozen graph.
+  std::span<const size_t> csr_offsets() const { return _offsets; }
+  std::span<const V> csr_targets() const { return _targets; }
+  size_t degree(V v) const { return adjacent(v).size(); }
 
-  void add_edge(Vertex u, Vertex v) {
+  void add_edge(V u, V v) {
+    CHECK(!_storage, "Graph: add_edge on a frozen graph.");
     _adj[u].push_back(v);
     if (!_dir) _adj[v].push_back(u);
+    _transpose.reset();
   }
 
-  const std::vector<Vertex>& operator [] (Vertex v) const {
-    CHECK(size_t(v) < _adj.size(),
-      "Graph: index %zu out of range [0..%zu).", size_t(v), _adj.size());
+  // Packs the adjacency lists into one offsets array and one contiguous
+  // target array (CSR). The graph becomes read-only, copies share the storage.
+  // A transpose built from the lists is dropped; the next one is CSR too.
+  void freeze() {
+    if (_storage) return;
 
-    if (!_seen.empty()) {
-      CHECK(!_seen[v], "Graph: vertex %zu examined second time", size_t(v));
-      _seen[v] = true;
+    auto csr = std::make_shared<Csr>();
+    csr->offsets.reserve(_adj.size() + 1);
+    csr->targets.reserve(count_edges());
+
+    csr->offsets.push_back(0);
+    for (const auto& list : _adj) {
+      csr->targets.insert(csr->targets.end(), list.begin(), list.end());
+      csr->offsets.push_back(csr->targets.size());
     }
 
-    return _adj[v];
+    _offsets = csr->offsets;
+    _targets = csr->targets;
+    _storage = std::move(csr);
+    std::vector<std::vector<V>>().swap(_adj);
+    _transpose.reset();
   }
 
-  
-  struct Iterator {
-    Iterator() = default;
+  std::span<const V> operator [] (V v) const {
+    _checks.access(v, vertices());
+    return adjacent(v);
+  }
 
-    Iterator& operator ++ () { _v++; return *this; }
-    Vertex operator * () const { return Vertex{_v}; }
+  // Graph with every edge flipped. Frozen graphs are transposed by counting
+  // sort straight into CSR.
+  BasicGraph reversed() const {
+    if (!_dir) return *this;
 
-    friend bool operator == (Iterator a, Iterator b) { return a._v == b._v; }
-    friend bool operator != (Iterator a, Iterator b) { return !(a == b); }
+    if (!_storage) {
+      BasicGraph ret(true, vertices());
+      for (size_t v = 0; v < vertices(); v++) for (V w : adjacent(v))
+        ret.add_edge(w, V(v));
+      return ret;
+    }
 
-    private:
-    friend struct Graph;
-    Iterator(size_t v) : _v(v) {}
+    std::vector<size_t> offsets(vertices() + 1, 0);
+    std::vector<V> targets(edges());
 
-    size_t _v = NO_VERTEX;
-  };
+    for (V w : _targets) offsets[w + 1]++;
+    for (size_t v = 0; v < vertices(); v++) offsets[v + 1] += offsets[v];
+
+    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+    for (size_t v = 0; v < vertices(); v++) for (V w : adjacent(v))
+      targets[pos[w]++] = V(v);
+
+    return from_csr(true, std::move(offsets), std::move(targets));
+  }
+
+  // reversed() built on first use and kept until the next add_edge, so that
+  // repeated callers share one transpose. Valid while the graph is alive and
+  // unchanged; an undirected graph is its own transpose.
+  const BasicGraph& transposed() const {
+    if (!_dir) return *this;
+    return _transpose.get_or_build([this] { return reversed(); });
+  }
+  
+  using Iterator = BasicVertexIterator<V>;
 
   Iterator begin() const { return { 0 }; }
   Iterator end() const { return { vertices() }; }
 
-  void bfs_debug_begin() const { _seen.assign(_adj.size(), false); }
-  void bfs_debug_end() const { _seen.assign(0, false); }
+  void bfs_debug_begin() const { _checks.debug_begin(vertices()); }
+  void bfs_debug_end() const { _checks.debug_end(); }
 
   private:
+  struct Csr {
+    std::vector<size_t> offsets;
+    std::vector<V> targets;
+  };
+
+  // Neighbors of v without the debug bookkeeping of operator [].
+  std::span<const V> adjacent(size_t v) const {
+    if (_storage) return _targets.subspan(_offsets[v], _offsets[v + 1] - _offsets[v]);
+    return _adj[v];
+  }
+
+  size_t count_edges() const {
+    size_t m = 0;
+    for (const auto& list : _adj) m += list.size();
+    return m;
+  }
+
   bool _dir;
-  std::vector<std::vector<Vertex>> _adj;
-  mutable std::vector<bool> _seen;
+  std::vector<std::vector<V>> _adj;
+  std::shared_ptr<const void> _storage;  // owner of the CSR arrays once frozen
+  std::span<const size_t> _offsets;
+  std::span<const V> _targets;
+  [[no_unique_address]] Checks _checks;
+  TransposeCache<BasicGraph> _transpose;
 };
 
-std::ostream& operator << (std::ostream& out, const Graph& G) {
+template<typename Checks, typename V>
+std::ostream& operator << (std::ostream& out, const BasicGraph<Checks, V>& G) {
   out << "{ " << (G.is_directed() ? "true" : "false") << ", { ";
-  for (Vertex v : G) {
+  for (V v : G) {
     out << "{";
-    for (Vertex w : G[v]) out << w << ",";
+    for (V w : G[v]) out << w << ",";
     out << "}, ";
   }
   return out << "} }";
 }
 
+#ifdef NDEBUG
+using GraphChecks = UncheckedAccess;
+#else
+using GraphChecks = CheckedAccess;
+#endif
+
+using Graph = BasicGraph<GraphChecks>;
+using Graph32 = BasicGraph<GraphChecks, Vertex32>;
+
 #endif
 
+// NO_VERTEX, ROOT and NO_DISTANCE for any vertex type.
+template<typename V> constexpr V no_vertex = V(std::numeric_limits<std::underlying_type_t<V>>::max());
+template<typename V> constexpr V root_vertex = V(std::numeric_limits<std::underlying_type_t<V>>::max() - 1);
+template<typename V> constexpr std::underlying_type_t<V> no_distance = no_vertex<V>;
+
 
 // - Arrays P and D have the correct size and are set to NO_VERTEX resp. NO_DISTANCE
 //   before calling bfs.
 // - Function bfs must set predecesor of u to ROOT.
 // - Return value is the number of visited vertices.
-size_t bfs(const Graph& G, Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+// - Works on any graph type with the Graph interface, e.g. CompressedGraph,
+//   and any vertex type, e.g. Graph32 with Vertex32 and uint32_t distances.
+template<typename GraphT, typename V, typename Dist>
+size_t bfs(const GraphT& G, V u, std::vector<V>& P, std::vector<Dist>& D) {
   // TODO implement
-  std::queue<Vertex> q;
+  std::queue<V> q;
   q.emplace(u);
-  P[u] = ROOT;
+  P[u] = root_vertex<V>;
   D[u] = 0;
 
-  int visited = 0;
+  size_t visited = 0;
   while(!q.empty()) {
       visited++;
-      const auto &v = q.front();
+      const V v = q.front();
       q.pop();
 
       for(auto neigh: G[v]) {
-          if(P[neigh] != NO_VERTEX) continue;
+          if(P[neigh] != no_vertex<V>) continue;
 
           P[neigh] = v;
           D[neigh] = D[v] + 1;
@@ -182,150 +394,2208 @@ size_t bfs(const Graph& G, Vertex u, std::vector<Vertex>& P, std::vector<size_t>
 }
 
 
-#ifndef __PROGTEST__
+enum class Visit { CONTINUE, STOP };
 
-const Graph SMALL_GRAPHS[] = {
-  { false, { {1}, {2}, {3}, {4}, {} } },
-  { false, { {1}, {2}, {3}, {4}, {0} } },
-  { false, { {1}, {2, 4}, {3}, {4}, {}, {} } },
-  { false, { {1}, {2, 5}, {3}, {4}, {}, {} } },
-  { false, { {1}, {2, 5}, {3}, {4}, {0}, {4} }},
-  { true, { {1}, {2}, {3}, {4}, {} } },
-  { true, { {1}, {2}, {3}, {4}, {0} } },
-  { true, { {1}, {2, 4}, {3}, {4}, {}, {} } },
-  { true, { {1}, {2, 5}, {3}, {4}, {}, {} } },
-  { true, { {1}, {2, 5}, {3}, {4}, {0}, {4} }},
+// Visitor of BfsWorkspace::run that never stops. Visitors derive from it and
+// hide the callbacks they care about; calls are resolved statically.
+// - discover(v, pred, dist) is called when v is reached for the first time.
+// - level_end(dist) is called once all vertices at distance dist are known,
+//   before any of them is expanded.
+struct BfsVisitor {
+    Visit discover(Vertex, Vertex, size_t) { return Visit::CONTINUE; }
+    Visit level_end(size_t) { return Visit::CONTINUE; }
 };
 
-struct RandomGraphGenerator {
-  RandomGraphGenerator(uint32_t seed) : my_rand(seed) {}
+// Reusable state for many searches on one graph. Entries of the predecessor
+// and distance arrays are valid only if stamped with the epoch of the current
+// search, so starting a search is O(1) and only visited entries are written.
+// The queue doubles as the list of visited vertices in BFS order.
+struct BfsWorkspace {
+    BfsWorkspace() = default;
+    explicit BfsWorkspace(size_t vertices) { reserve(vertices); }
 
-  uint32_t num(uint32_t max) { return my_rand() % max; }
-  Vertex vertex(const Graph& G) { return Vertex{num(G.vertices())}; }
+    void reserve(size_t vertices) {
+        if(vertices <= _stamp.size()) return;
 
-  Graph graph1(uint32_t s, size_t edges, bool directed = true) {
-    Graph G(directed, s);
+        _stamp.resize(vertices, 0);
+        _pred.resize(vertices);
+        _dist.resize(vertices);
+        _queue.reserve(vertices);
+    }
 
-    while (edges--) {
-      auto u = vertex(G);
-      auto v = vertex(G);
-      G.add_edge(u, v);
+    // Searches from u, returns the number of visited vertices.
+    template<typename GraphT>
+    size_t run(const GraphT &G, Vertex u) {
+        return run(G, u, NO_DISTANCE, BfsVisitor{});
     }
 
-    return G;
-  }
+    // Searches from u up to distance max_depth, or until the visitor returns
+    // Visit::STOP. Returns the number of discovered vertices.
+    template<typename GraphT, typename Visitor>
+    size_t run(const GraphT &G, Vertex u, size_t max_depth, Visitor &&visitor) {
+        reserve(G.vertices());
+        next_epoch();
+        _queue.clear();
 
-  Graph graph2(uint32_t s, double density, bool directed = true) {
-    Graph G(directed, s);
+        visit(u, ROOT, 0);
+        if(visitor.discover(u, ROOT, 0) == Visit::STOP)
+            return _queue.size();
 
-    for (Vertex u : G) for (Vertex v : G)
-      if (num(1'000'000'000) < 1'000'000'000*density) G.add_edge(u, v);
+        size_t level_begin = 0;
+        for(size_t depth = 0; level_begin < _queue.size(); depth++) {
+            const size_t level_end = _queue.size();
+            if(visitor.level_end(depth) == Visit::STOP || depth == max_depth)
+                break;
 
-    return G;
-  }
+            for(size_t head = level_begin; head < level_end; head++) {
+                const Vertex v = _queue[head];
+                for(auto neigh: G[v]) {
+                    if(_stamp[neigh] == _epoch) continue;
+
+                    visit(neigh, v, depth + 1);
+                    if(visitor.discover(neigh, v, depth + 1) == Visit::STOP)
+                        return _queue.size();
+                }
+            }
+            level_begin = level_end;
+        }
+        return _queue.size();
+    }
+
+    bool seen(Vertex v) const { return _stamp[v] == _epoch; }
+    Vertex pred(Vertex v) const { return seen(v) ? _pred[v] : NO_VERTEX; }
+    size_t dist(Vertex v) const { return seen(v) ? _dist[v] : NO_DISTANCE; }
+    const std::vector<Vertex> &order() const { return _queue; }
 
   private:
-  std::mt19937 my_rand;
+    void next_epoch() {
+        if(++_epoch != 0) return;
+
+        std::fill(_stamp.begin(), _stamp.end(), 0);
+        _epoch = 1;
+    }
+
+    void visit(Vertex v, Vertex pred, size_t dist) {
+        _stamp[v] = _epoch;
+        _pred[v] = pred;
+        _dist[v] = dist;
+        _queue.push_back(v);
+    }
+
+    std::vector<uint32_t> _stamp;
+    std::vector<Vertex> _pred;
+    std::vector<size_t> _dist;
+    std::vector<Vertex> _queue;
+    uint32_t _epoch = 0;
 };
 
 
-void test_bfs_inner(const Graph& G, Vertex u) {
-  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
-  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+// Switching thresholds of the direction-optimizing BFS (Beamer et al.).
+constexpr size_t HYBRID_ALPHA = 14;
+constexpr size_t HYBRID_BETA = 24;
 
-  G.bfs_debug_begin();
-  size_t seen_t = bfs(G, u, P, D);
-  G.bfs_debug_end();
+// Same contract as bfs. Levels are expanded top-down from the frontier list
+// while it is small; once the frontier's edges outweigh those of the
+// unvisited vertices every unvisited vertex instead scans its predecessors
+// for a parent in the frontier bitmap (bottom-up), until the frontier shrinks
+// again. RG lists the predecessors of each vertex, i.e. G.transposed().
+size_t bfs_hybrid(const Graph &G, const Graph &RG, Vertex u,
+                  std::vector<Vertex> &P, std::vector<size_t> &D) {
+    const size_t n = G.vertices();
+    P[u] = ROOT;
+    D[u] = 0;
 
-  std::vector<bool> pred_ok(G.vertices(), false);
+    std::vector<Vertex> frontier{u}, next;
+    std::vector<bool> in_frontier;
+    size_t frontier_edges = G.degree(u);
+    size_t unexplored_edges = G.edges() - frontier_edges;
+    size_t prev_size = 0;
+    size_t visited = 1;
+    bool bottom_up = false;
 
-  CHECK(P[u] == ROOT, "P[u] != ROOT but %zu.", size_t(P[u]));
-  CHECK(D[u] == 0, "D[u] != 0 but %zu.", D[u]);
-  pred_ok[u] = true;
+    for(size_t level = 1; !frontier.empty(); level++) {
+        if(!bottom_up)
+            bottom_up = frontier_edges > unexplored_edges / HYBRID_ALPHA
+                        && frontier.size() > prev_size;
+        else
+            bottom_up = frontier.size() >= n / HYBRID_BETA
+                        || frontier.size() >= prev_size;
 
-  for (Vertex v : G) {
-    if (P[v] == NO_VERTEX) {
-      CHECK(D[v] == NO_DISTANCE, "P[%zu] == NO_VERTEX but D[%u] == %zu not NO_DISTANCE.",
-        size_t(v), size_t(v), D[v]);
+        next.clear();
+        frontier_edges = 0;
 
-      pred_ok[v] = true;
-      continue;
+        if(bottom_up) {
+            in_frontier.assign(n, false);
+            for(auto v: frontier) in_frontier[v] = true;
+
+            for(auto v: G) {
+                if(P[v] != NO_VERTEX) continue;
+
+                for(auto pred: RG[v]) {
+                    if(!in_frontier[pred]) continue;
+
+                    P[v] = pred;
+                    D[v] = level;
+                    next.push_back(v);
+                    frontier_edges += G.degree(v);
+                    break;
+                }
+            }
+        } else {
+            for(auto v: frontier) {
+                for(auto neigh: G[v]) {
+                    if(P[neigh] != NO_VERTEX) continue;
+
+                    P[neigh] = v;
+                    D[neigh] = level;
+                    next.push_back(neigh);
+                    frontier_edges += G.degree(neigh);
+                }
+            }
+        }
+
+        unexplored_edges -= frontier_edges;
+        visited += next.size();
+        prev_size = frontier.size();
+        std::swap(frontier, next);
     }
+    return visited;
+}
 
-    if (v != u) {
-      CHECK(P[v] < G.vertices(),
-        "P[%zu] == %zu >= %zu (# of vertices).", size_t(v), size_t(P[v]), G.vertices());
-      CHECK(P[P[v]] != NO_VERTEX,
-        "P[%zu] == %zu but P[%zu] == NO_VERTEX.", size_t(v), size_t(P[v]), size_t(P[v]));
+size_t bfs_hybrid(const Graph &G, Vertex u,
+                  std::vector<Vertex> &P, std::vector<size_t> &D) {
+    return bfs_hybrid(G, G.transposed(), u, P, D);
+}
+
+
+// Frontier vertices handed to a worker at once.
+constexpr size_t PARALLEL_CHUNK = 256;
+
+// Same contract as bfs, each level is expanded by `threads` workers. Workers
+// take chunks of the frontier, claim P[w] with a CAS so every vertex gets
+// exactly one predecessor and collect the claimed vertices in their own
+// buffer; the buffers are then copied side by side into the next frontier.
+size_t bfs_parallel(const Graph &G, Vertex u, std::vector<Vertex> &P,
+                    std::vector<size_t> &D,
+                    size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    P[u] = ROOT;
+    D[u] = 0;
+
+    std::vector<Vertex> frontier{u}, next;
+    std::vector<std::vector<Vertex>> local(threads);
+    std::vector<size_t> offset(threads);
+    std::atomic<size_t> cursor{0};
+    size_t level = 1;
+    size_t visited = 1;
+    bool expanding = true;
+    bool done = false;
+
+    auto on_phase_end = [&]() noexcept {
+        if(expanding) {
+            size_t total = 0;
+            for(size_t t = 0; t < threads; t++) {
+                offset[t] = total;
+                total += local[t].size();
+            }
+            next.resize(total);
+        } else {
+            std::swap(frontier, next);
+            visited += frontier.size();
+            cursor.store(0, std::memory_order_relaxed);
+            level++;
+            done = frontier.empty();
+        }
+        expanding = !expanding;
+    };
+    std::barrier sync(static_cast<std::ptrdiff_t>(threads), on_phase_end);
+
+    auto worker = [&](size_t id) {
+        auto &mine = local[id];
+        while(!done) {
+            size_t begin;
+            while((begin = cursor.fetch_add(PARALLEL_CHUNK, std::memory_order_relaxed))
+                  < frontier.size()) {
+                const size_t end = std::min(begin + PARALLEL_CHUNK, frontier.size());
+                for(size_t i = begin; i < end; i++) {
+                    const Vertex v = frontier[i];
+                    for(auto neigh: G[v]) {
+                        std::atomic_ref<Vertex> pred(P[neigh]);
+                        if(pred.load(std::memory_order_relaxed) != NO_VERTEX) continue;
+
+                        Vertex expected = NO_VERTEX;
+                        if(!pred.compare_exchange_strong(expected, v, std::memory_order_relaxed))
+                            continue;
+
+                        D[neigh] = level;
+                        mine.push_back(neigh);
+                    }
+                }
+            }
+            sync.arrive_and_wait();
+
+            std::copy(mine.begin(), mine.end(), next.begin() + offset[id]);
+            mine.clear();
+            sync.arrive_and_wait();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(size_t id = 1; id < threads; id++)
+        pool.emplace_back(worker, id);
+    worker(0);
+    for(auto &t: pool) t.join();
+
+    return visited;
+}
+
+
+// Set of BFS sources of one batch, bit i of word i / 64 stands for source i.
+template<size_t Words>
+using SourceSet = std::array<uint64_t, Words>;
+
+template<size_t Words>
+bool any_source(const SourceSet<Words> &set) {
+    uint64_t acc = 0;
+    for(auto word: set) acc |= word;
+    return acc != 0;
+}
+
+// Bit-parallel BFS from up to 64 * Words sources at once (MS-BFS). Every
+// vertex keeps the sources that have seen it and the sources whose frontier
+// it is in, so one scan of G[v] advances all searches that reached v on the
+// same level. D[i] receives the distances from sources[first + i].
+template<size_t Words>
+void bfs_multi_batch(const Graph &G, const std::vector<Vertex> &sources, size_t first,
+                     std::vector<std::vector<size_t>> &D) {
+    const size_t n = G.vertices();
+    const size_t count = std::min(sources.size() - first, 64 * Words);
+
+    std::vector<SourceSet<Words>> seen(n), visit(n), visit_next(n);
+    for(size_t i = 0; i < count; i++) {
+        const Vertex s = sources[first + i];
+        seen[s][i / 64] |= uint64_t(1) << (i % 64);
+        visit[s][i / 64] |= uint64_t(1) << (i % 64);
+        D[first + i][s] = 0;
     }
-    
 
-    for (Vertex w : G[v]) {
-      CHECK(D[w] <= D[v] + 1, "D[%zu] == %zu but its neighbor has D[%zu] == %zu.",
-        size_t(w), D[w], size_t(v), D[v]);
-    
-      if (P[w] != v) continue;
+    for(size_t level = 1; ; level++) {
+        for(auto v: G) {
+            if(!any_source(visit[v])) continue;
+            for(auto neigh: G[v])
+                for(size_t k = 0; k < Words; k++)
+                    visit_next[neigh][k] |= visit[v][k];
+        }
 
-      CHECK(D[w] == D[v] + 1, "P[%zu] == %zu but D[%zu] == %zu != D[%zu] + 1 == %zu",
-        size_t(w), size_t(v), size_t(w), D[w], size_t(v), 1 + D[v]);
-      pred_ok[w] = true;
+        bool active = false;
+        for(auto v: G) {
+            auto &next = visit_next[v];
+            for(size_t k = 0; k < Words; k++) {
+                next[k] &= ~seen[v][k];
+                seen[v][k] |= next[k];
+
+                for(uint64_t bits = next[k]; bits; bits &= bits - 1)
+                    D[first + 64 * k + std::countr_zero(bits)][v] = level;
+            }
+            active |= any_source(next);
+            visit[v] = next;
+            next = {};
+        }
+
+        if(!active) break;
     }
-  }
+}
 
-  size_t seen_r = 0;
-  for (Vertex v : G) {
-    CHECK(pred_ok[v], "P[%zu] == %zu but there is no edge.", size_t(v), size_t(P[v]));
-    seen_r += (P[v] != NO_VERTEX);
-  }
+// Distances from each of the sources, D[i][v] == NO_DISTANCE if v is not
+// reachable from sources[i]. Sources are processed in batches of 64 * Words.
+template<size_t Words = 1>
+std::vector<std::vector<size_t>> bfs_multi(const Graph &G, const std::vector<Vertex> &sources) {
+    std::vector<std::vector<size_t>> D(sources.size(),
+                                       std::vector<size_t>(G.vertices(), NO_DISTANCE));
 
-  CHECK(seen_r == seen_t,
-    "Reported size of component is %zu but it should be %zu.", seen_t, seen_r);
+    for(size_t first = 0; first < sources.size(); first += 64 * Words)
+        bfs_multi_batch<Words>(G, sources, first, D);
+    return D;
 }
 
-void test_bfs(const Graph& G, Vertex u) {
-  try {
-    test_bfs_inner(G, u);
-  } catch (const TestFailed& e) {
-    G.bfs_debug_end();
-    std::cout << "Test failed: v = " << u << ", G = " << G << "\n"
-              << e.what() << std::endl;
-    throw;
-  }
+
+// Expands one whole level of a bidirectional search. `pred` maps vertices seen
+// by this side to their parent towards its root, `other` is the opposite side.
+// Returns the vertex where the shortest connection found on this level meets
+// the other side, NO_VERTEX if none did.
+Vertex expand_level(const Graph &G, std::vector<Vertex> &frontier,
+                    std::unordered_map<size_t, Vertex> &pred,
+                    const std::unordered_map<size_t, Vertex> &other,
+                    const std::unordered_map<size_t, size_t> &other_dist,
+                    std::unordered_map<size_t, size_t> &dist) {
+    std::vector<Vertex> next;
+    Vertex meet = NO_VERTEX;
+    size_t best = NO_DISTANCE;
+
+    for(auto v: frontier) {
+        for(auto neigh: G[v]) {
+            if(pred.count(neigh)) continue;
+
+            pred.emplace(neigh, v);
+            dist.emplace(neigh, dist.at(v) + 1);
+            next.push_back(neigh);
+
+            if(other.count(neigh) && other_dist.at(neigh) < best) {
+                best = other_dist.at(neigh);
+                meet = neigh;
+            }
+        }
+    }
+
+    std::swap(frontier, next);
+    return meet;
 }
 
+// Shortest path from s to t found by growing BFS frontiers from both ends,
+// always expanding the smaller one, until they meet. RG lists predecessors of
+// each vertex (G itself when undirected). Returns the length and the path
+// s, ..., t, or NO_DISTANCE and an empty path if t is unreachable.
+std::pair<size_t, std::vector<Vertex>> shortest_path(const Graph &G, const Graph &RG,
+                                                     Vertex s, Vertex t) {
+    std::unordered_map<size_t, Vertex> fwd{{s, ROOT}}, bwd{{t, ROOT}};
+    std::unordered_map<size_t, size_t> fwd_dist{{s, 0}}, bwd_dist{{t, 0}};
+    std::vector<Vertex> fwd_frontier{s}, bwd_frontier{t};
 
-void run_tests() {
-  std::cout << "Hardcoded graphs..." << std::endl;
-  for (const Graph& G : SMALL_GRAPHS) for (Vertex u : G) test_bfs(G, u);
-  
-  RandomGraphGenerator rgg(53323);
-  std::cout << "Small random graphs..." << std::endl;
-  for (size_t i = 0; i < 30; i++) {
-    Graph G = rgg.graph1(10 + i, 4*(10 + i));
-    Vertex u = rgg.vertex(G);
-    test_bfs(G, u);
-  }
-  for (size_t i = 0; i < 30; i++) {
-    Graph G = rgg.graph2(10 + i, 0.7);
-    Vertex u = rgg.vertex(G);
-    test_bfs(G, u);
-  }
+    Vertex meet = s == t ? s : NO_VERTEX;
+    while(meet == NO_VERTEX && !fwd_frontier.empty() && !bwd_frontier.empty()) {
+        if(fwd_frontier.size() <= bwd_frontier.size())
+            meet = expand_level(G, fwd_frontier, fwd, bwd, bwd_dist, fwd_dist);
+        else
+            meet = expand_level(RG, bwd_frontier, bwd, fwd, fwd_dist, bwd_dist);
+    }
 
-  std::cout << "Big random graphs..." << std::endl;
-  for (size_t i = 0; i < 20; i++) {
-    Graph G = rgg.graph1(30'000 + 50*i, 150'000 + 300*i);
-    Vertex u = rgg.vertex(G);
-    test_bfs(G, u);
-  }
-  for (size_t i = 0; i < 20; i++) {
-    Graph G = rgg.graph2(900 + i, 0.7);
-    Vertex u = rgg.vertex(G);
-    test_bfs(G, u);
-  }
+    if(meet == NO_VERTEX)
+        return {NO_DISTANCE, {}};
+
+    std::vector<Vertex> path;
+    for(Vertex v = meet; v != ROOT; v = fwd.at(v))
+        path.push_back(v);
+    std::reverse(path.begin(), path.end());
+    for(Vertex v = bwd.at(meet); v != ROOT; v = bwd.at(v))
+        path.push_back(v);
+
+    return {path.size() - 1, path};
 }
 
-int main() {
-  try {
+std::pair<size_t, std::vector<Vertex>> shortest_path(const Graph &G, Vertex s, Vertex t) {
+    return shortest_path(G, G.transposed(), s, t);
+}
+
+
+// Vertex permutation for locality, new_id[old] and its inverse old_id[new].
+struct Relabeling {
+    std::vector<Vertex> new_id;
+    std::vector<Vertex> old_id;
+};
+
+Relabeling relabeling_from_order(std::vector<Vertex> old_id) {
+    std::vector<Vertex> new_id(old_id.size());
+    for(size_t i = 0; i < old_id.size(); i++)
+        new_id[old_id[i]] = Vertex{i};
+    return {std::move(new_id), std::move(old_id)};
+}
+
+// Vertices by decreasing degree, so the hubs most traversals go through share
+// cache lines at the front of every array.
+Relabeling degree_order(const Graph &G) {
+    std::vector<Vertex> order;
+    order.reserve(G.vertices());
+    for(auto v: G) order.push_back(v);
+
+    std::stable_sort(order.begin(), order.end(), [&](Vertex a, Vertex b) {
+        return G.degree(a) > G.degree(b);
+    });
+    return relabeling_from_order(std::move(order));
+}
+
+// Reverse Cuthill-McKee: BFS from a minimum degree vertex of every yet
+// unvisited part, neighbors taken by increasing degree, order reversed.
+// Neighbors end up with nearby IDs, which keeps frontiers compact.
+Relabeling rcm_order(const Graph &G) {
+    std::vector<Vertex> starts;
+    starts.reserve(G.vertices());
+    for(auto v: G) starts.push_back(v);
+
+    std::stable_sort(starts.begin(), starts.end(), [&](Vertex a, Vertex b) {
+        return G.degree(a) < G.degree(b);
+    });
+
+    std::vector<bool> visited(G.vertices());
+    std::vector<Vertex> order, neighs;
+    order.reserve(G.vertices());
+
+    for(auto start: starts) {
+        if(visited[start]) continue;
+
+        visited[start] = true;
+        order.push_back(start);
+        for(size_t head = order.size() - 1; head < order.size(); head++) {
+            neighs.clear();
+            for(auto neigh: G[order[head]])
+                if(!visited[neigh]) {
+                    visited[neigh] = true;
+                    neighs.push_back(neigh);
+                }
+
+            std::stable_sort(neighs.begin(), neighs.end(), [&](Vertex a, Vertex b) {
+                return G.degree(a) < G.degree(b);
+            });
+            order.insert(order.end(), neighs.begin(), neighs.end());
+        }
+    }
+
+    std::reverse(order.begin(), order.end());
+    return relabeling_from_order(std::move(order));
+}
+
+// Frozen copy of G with vertex v renamed to r.new_id[v] and sorted neighbor
+// lists, built once and amortized over many traversals.
+Graph relabel(const Graph &G, const Relabeling &r) {
+    std::vector<size_t> offsets(G.vertices() + 1, 0);
+    std::vector<Vertex> targets;
+    targets.reserve(G.edges());
+
+    for(size_t i = 0; i < G.vertices(); i++) {
+        const auto begin = targets.size();
+        for(auto neigh: G[r.old_id[i]])
+            targets.push_back(r.new_id[neigh]);
+
+        std::sort(targets.begin() + begin, targets.end());
+        offsets[i + 1] = targets.size();
+    }
+
+    return Graph::from_csr(G.is_directed(), std::move(offsets), std::move(targets));
+}
+
+// Translates bfs results on relabel(G, r) back to the original vertex IDs.
+void restore_labels(const Relabeling &r, std::vector<Vertex> &P, std::vector<size_t> &D) {
+    std::vector<Vertex> orig_P(P.size());
+    std::vector<size_t> orig_D(D.size());
+
+    for(size_t i = 0; i < P.size(); i++) {
+        const Vertex p = P[i];
+        orig_P[r.old_id[i]] = p == ROOT || p == NO_VERTEX ? p : r.old_id[p];
+        orig_D[r.old_id[i]] = D[i];
+    }
+
+    std::swap(P, orig_P);
+    std::swap(D, orig_D);
+}
+
+
+// LEB128 varints, 7 bits per byte, high bit set on all but the last byte.
+void write_varint(std::vector<uint8_t> &out, size_t value) {
+    while(value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+inline size_t read_varint(const uint8_t *&in) {
+    size_t value = *in & 0x7f;
+    for(unsigned shift = 7; *in++ & 0x80; shift += 7)
+        value |= size_t(*in & 0x7f) << shift;
+    return value;
+}
+
+// Read-only graph with every neighbor list sorted and stored as varints: the
+// degree, the first neighbor relative to the vertex itself (zigzag encoded)
+// and then the gaps between consecutive neighbors. Small gaps, e.g. after
+// rcm_order, take a single byte instead of eight. Has the Graph interface,
+// so bfs runs on it directly.
+struct CompressedGraph {
+    struct NeighborIterator {
+        Vertex operator * () const { return Vertex{_cur}; }
+        NeighborIterator& operator ++ () {
+            if(--_left) _cur += read_varint(_pos);
+            return *this;
+        }
+
+        friend bool operator == (const NeighborIterator &it, std::default_sentinel_t) {
+            return it._left == 0;
+        }
+
+        const uint8_t *_pos;
+        size_t _left;
+        size_t _cur;
+    };
+
+    struct Neighbors {
+        NeighborIterator begin() const {
+            const uint8_t *pos = _pos;
+            const size_t degree = read_varint(pos);
+            if(degree == 0) return {pos, 0, 0};
+
+            const size_t first = read_varint(pos);
+            const size_t delta = first & 1 ? ~(first >> 1) : first >> 1;
+            return {pos, degree, _v + delta};
+        }
+        std::default_sentinel_t end() const { return {}; }
+
+        size_t size() const {
+            const uint8_t *pos = _pos;
+            return read_varint(pos);
+        }
+        bool empty() const { return size() == 0; }
+
+        const uint8_t *_pos;
+        size_t _v;
+    };
+
+    CompressedGraph() = default;
+    explicit CompressedGraph(const Graph &G) : _dir(G.is_directed()) {
+        _offsets.reserve(G.vertices() + 1);
+        std::vector<Vertex> list;
+
+        for(auto v: G) {
+            _offsets.push_back(_bytes.size());
+            auto neighs = G[v];
+            list.assign(neighs.begin(), neighs.end());
+            std::sort(list.begin(), list.end());
+
+            write_varint(_bytes, list.size());
+            if(list.empty()) continue;
+
+            const size_t delta = list[0] - size_t(v);
+            write_varint(_bytes, delta >> 63 ? ~(delta << 1) : delta << 1);
+            for(size_t i = 1; i < list.size(); i++)
+                write_varint(_bytes, list[i] - list[i - 1]);
+        }
+
+        _offsets.push_back(_bytes.size());
+        _bytes.shrink_to_fit();
+    }
+
+    bool is_directed() const { return _dir; }
+    size_t vertices() const { return _offsets.empty() ? 0 : _offsets.size() - 1; }
+    size_t bytes() const { return _bytes.size() + _offsets.size() * sizeof(size_t); }
+
+    Neighbors operator [] (Vertex v) const {
+        CHECK(size_t(v) < vertices(),
+          "CompressedGraph: index %zu out of range [0..%zu).", size_t(v), vertices());
+        return {_bytes.data() + _offsets[v], v};
+    }
+
+    VertexIterator begin() const { return { 0 }; }
+    VertexIterator end() const { return { vertices() }; }
+
+  private:
+    bool _dir = false;
+    std::vector<size_t> _offsets;
+    std::vector<uint8_t> _bytes;
+};
+
+
+// BFS over an implicit graph, nothing is materialized: neighbors(s, emit)
+// calls emit(t) for every successor t of state s and index(s) maps states to
+// dense IDs below n. P and D are indexed by these IDs and follow the bfs
+// contract, the return value is the number of visited states.
+template<typename State, typename Index, typename Neighbors>
+size_t implicit_bfs(const State &start, Index &&index, Neighbors &&neighbors,
+                    std::vector<Vertex> &P, std::vector<size_t> &D) {
+    std::queue<State> q;
+    const Vertex u{index(start)};
+    P[u] = ROOT;
+    D[u] = 0;
+    q.push(start);
+
+    size_t visited = 0;
+    while(!q.empty()) {
+        visited++;
+        const State s = std::move(q.front());
+        q.pop();
+
+        const Vertex v{index(s)};
+        neighbors(s, [&](const State &t) {
+            const Vertex w{index(t)};
+            if(P[w] != NO_VERTEX) return;
+
+            P[w] = v;
+            D[w] = D[v] + 1;
+            q.push(t);
+        });
+    }
+    return visited;
+}
+
+template<typename State>
+struct ImplicitVisit {
+    State pred;   // the start state is its own predecessor
+    size_t dist;
+};
+
+// The same for state spaces without a dense index, e.g. huge or unbounded
+// ones: discovered states live in a hash map, which is returned. Only states
+// up to max_depth from start are discovered.
+template<typename State, typename Hash = std::hash<State>, typename Neighbors>
+std::unordered_map<State, ImplicitVisit<State>, Hash>
+implicit_bfs(const State &start, Neighbors &&neighbors, size_t max_depth = NO_DISTANCE) {
+    std::unordered_map<State, ImplicitVisit<State>, Hash> seen{{start, {start, 0}}};
+    std::vector<State> frontier{start}, next;
+
+    for(size_t depth = 0; depth < max_depth && !frontier.empty(); depth++) {
+        next.clear();
+        for(const auto &s: frontier) {
+            neighbors(s, [&](const State &t) {
+                if(seen.try_emplace(t, ImplicitVisit<State>{s, depth + 1}).second)
+                    next.push_back(t);
+            });
+        }
+        std::swap(frontier, next);
+    }
+    return seen;
+}
+
+
+// Minimal lazy sequence for coroutines: the body runs only while the
+// consumer advances the iterator. Move-only, owns the coroutine frame.
+template<typename T>
+struct Generator {
+    struct promise_type {
+        const T *current = nullptr;
+
+        Generator get_return_object() {
+            return Generator{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(const T &value) noexcept {
+            current = std::addressof(value);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { throw; }
+    };
+
+    struct Iterator {
+        const T &operator * () const { return *_handle.promise().current; }
+        Iterator &operator ++ () {
+            _handle.resume();
+            return *this;
+        }
+        friend bool operator == (const Iterator &it, std::default_sentinel_t) {
+            return it._handle.done();
+        }
+
+        std::coroutine_handle<promise_type> _handle;
+    };
+
+    explicit Generator(std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+    Generator(Generator &&other) noexcept : _handle(std::exchange(other._handle, {})) {}
+    Generator &operator = (Generator other) noexcept {
+        std::swap(_handle, other._handle);
+        return *this;
+    }
+    ~Generator() { if(_handle) _handle.destroy(); }
+
+    Iterator begin() {
+        _handle.resume();
+        return {_handle};
+    }
+    std::default_sentinel_t end() const { return {}; }
+
+  private:
+    std::coroutine_handle<promise_type> _handle;
+};
+
+struct BfsItem {
+    Vertex vertex;
+    size_t dist;
+    Vertex pred;
+};
+
+// Vertices reachable from u in BFS order, produced lazily: the search is
+// suspended after every item and only goes on when the consumer asks for
+// the next one, so stopping early saves the rest of the traversal. G must
+// outlive the generator.
+template<typename GraphT>
+Generator<BfsItem> bfs_stream(const GraphT &G, Vertex u) {
+    std::vector<bool> seen(G.vertices());
+    std::queue<BfsItem> q;
+    seen[u] = true;
+    q.push({u, 0, ROOT});
+
+    while(!q.empty()) {
+        const BfsItem item = q.front();
+        q.pop();
+        co_yield item;
+
+        for(auto neigh: G[item.vertex]) {
+            if(seen[neigh]) continue;
+
+            seen[neigh] = true;
+            q.push({neigh, item.dist + 1, item.vertex});
+        }
+    }
+}
+
+
+// Single-source BFS result kept up to date while edges are added to G.
+// An insertion only lowers distances, so only the vertices whose distance
+// improves are revisited, in BFS order starting from the new edge's head.
+// G must outlive the structure and must only grow through add_edge here.
+struct DynamicBfs {
+    DynamicBfs(Graph &G, Vertex root)
+        : _G(G), _P(G.vertices(), NO_VERTEX), _D(G.vertices(), NO_DISTANCE) {
+        _visited = bfs(G, root, _P, _D);
+    }
+
+    void add_edge(Vertex u, Vertex v) {
+        _G.add_edge(u, v);
+        relax(u, v);
+        if(!_G.is_directed()) relax(v, u);
+
+        while(!_queue.empty()) {
+            const Vertex x = _queue.front();
+            _queue.pop();
+            for(auto y: _G[x]) relax(x, y);
+        }
+    }
+
+    const std::vector<Vertex> &P() const { return _P; }
+    const std::vector<size_t> &D() const { return _D; }
+    size_t visited() const { return _visited; }
+
+  private:
+    void relax(Vertex from, Vertex to) {
+        if(_D[from] == NO_DISTANCE || _D[from] + 1 >= _D[to]) return;
+
+        _visited += _D[to] == NO_DISTANCE;
+        _D[to] = _D[from] + 1;
+        _P[to] = from;
+        _queue.push(to);
+    }
+
+    Graph &_G;
+    std::vector<Vertex> _P;
+    std::vector<size_t> _D;
+    std::queue<Vertex> _queue;
+    size_t _visited;
+};
+
+
+// Adjacency matrix with one bit per vertex pair, rows padded to whole
+// 64-bit words. For dense graphs this is 64x smaller than neighbor lists.
+struct DenseGraph {
+    DenseGraph() = default;
+    explicit DenseGraph(const Graph &G)
+        : _n(G.vertices()), _words((_n + 63) / 64), _bits(_n * _words, 0) {
+        for(auto v: G)
+            for(auto w: G[v])
+                _bits[v * _words + w / 64] |= uint64_t(1) << (w % 64);
+    }
+
+    size_t vertices() const { return _n; }
+    size_t words() const { return _words; }
+
+    bool has_edge(Vertex u, Vertex v) const {
+        return _bits[u * _words + v / 64] >> (v % 64) & 1;
+    }
+
+    // Neighbors of v as a bitset of words() words.
+    std::span<const uint64_t> row(Vertex v) const {
+        CHECK(size_t(v) < _n, "DenseGraph: index %zu out of range [0..%zu).", size_t(v), _n);
+        return {_bits.data() + v * _words, _words};
+    }
+
+  private:
+    size_t _n = 0;
+    size_t _words = 0;
+    std::vector<uint64_t> _bits;
+};
+
+// Same contract as bfs on the adjacency matrix. Each frontier vertex claims
+// (row AND NOT seen) in whole words, which also yields the predecessors, and
+// ORs the claimed bits into seen; scanning a row costs n / 64 word
+// operations regardless of the degree.
+size_t bfs_dense(const DenseGraph &G, Vertex u, std::vector<Vertex> &P, std::vector<size_t> &D) {
+    const size_t words = G.words();
+    std::vector<uint64_t> seen(words, 0);
+    std::vector<Vertex> frontier{u}, next;
+
+    seen[u / 64] |= uint64_t(1) << (u % 64);
+    P[u] = ROOT;
+    D[u] = 0;
+
+    size_t visited = 1;
+    for(size_t level = 1; !frontier.empty(); level++) {
+        next.clear();
+        for(auto v: frontier) {
+            const auto row = G.row(v);
+            for(size_t k = 0; k < words; k++) {
+                uint64_t fresh = row[k] & ~seen[k];
+                seen[k] |= fresh;
+
+                for(; fresh; fresh &= fresh - 1) {
+                    const Vertex w{64 * k + std::countr_zero(fresh)};
+                    P[w] = v;
+                    D[w] = level;
+                    next.push_back(w);
+                }
+            }
+        }
+
+        visited += next.size();
+        std::swap(frontier, next);
+    }
+    return visited;
+}
+
+
+struct WeightedEdge {
+    Vertex to;
+    uint32_t weight;
+};
+
+// Graph with small non-negative integer edge weights, same conventions as
+// Graph (undirected edges are stored in both directions).
+struct WeightedGraph {
+    WeightedGraph() : WeightedGraph(false, 0) {}
+    WeightedGraph(bool directed, size_t vertices) : _dir(directed), _adj(vertices) {}
+
+    bool is_directed() const { return _dir; }
+    size_t vertices() const { return _adj.size(); }
+    uint32_t max_weight() const { return _max_weight; }
+
+    void add_edge(Vertex u, Vertex v, uint32_t weight) {
+        _adj[u].push_back({v, weight});
+        if(!_dir) _adj[v].push_back({u, weight});
+        _max_weight = std::max(_max_weight, weight);
+    }
+
+    std::span<const WeightedEdge> operator [] (Vertex v) const {
+        CHECK(size_t(v) < _adj.size(),
+          "WeightedGraph: index %zu out of range [0..%zu).", size_t(v), _adj.size());
+        return _adj[v];
+    }
+
+    VertexIterator begin() const { return { 0 }; }
+    VertexIterator end() const { return { vertices() }; }
+
+  private:
+    bool _dir;
+    uint32_t _max_weight = 0;
+    std::vector<std::vector<WeightedEdge>> _adj;
+};
+
+// Shortest paths over 0/1 weights: 0-edges go to the front of the deque,
+// 1-edges to the back, so vertices leave it in order of distance. Same
+// contract as bfs with D holding weighted distances; the return value is
+// the number of reached vertices.
+size_t bfs_01(const WeightedGraph &G, Vertex u, std::vector<Vertex> &P, std::vector<size_t> &D) {
+    CHECK(G.max_weight() <= 1, "bfs_01: edge weight %u > 1.", G.max_weight());
+
+    std::vector<bool> done(G.vertices());
+    std::deque<Vertex> q{u};
+    P[u] = ROOT;
+    D[u] = 0;
+
+    size_t visited = 0;
+    while(!q.empty()) {
+        const Vertex v = q.front();
+        q.pop_front();
+        if(done[v]) continue;
+        done[v] = true;
+        visited++;
+
+        for(const auto &[to, weight]: G[v]) {
+            if(D[v] + weight >= D[to]) continue;
+
+            D[to] = D[v] + weight;
+            P[to] = v;
+            if(weight) q.push_back(to);
+            else q.push_front(to);
+        }
+    }
+    return visited;
+}
+
+// Dial's algorithm: Dijkstra with a cyclic array of max_weight + 1 buckets
+// instead of a heap, tentative distances are at most max_weight apart. Stale
+// bucket entries are skipped when popped. Same contract as bfs_01.
+size_t dial(const WeightedGraph &G, Vertex u, std::vector<Vertex> &P, std::vector<size_t> &D) {
+    const size_t span = size_t(G.max_weight()) + 1;
+    std::vector<std::vector<Vertex>> buckets(span);
+    std::vector<bool> done(G.vertices());
+
+    P[u] = ROOT;
+    D[u] = 0;
+    buckets[0].push_back(u);
+
+    size_t pending = 1;
+    size_t visited = 0;
+    for(size_t dist = 0; pending; ) {
+        auto &bucket = buckets[dist % span];
+        if(bucket.empty()) {
+            dist++;
+            continue;
+        }
+
+        const Vertex v = bucket.back();
+        bucket.pop_back();
+        pending--;
+        if(done[v] || D[v] != dist) continue;
+        done[v] = true;
+        visited++;
+
+        for(const auto &[to, weight]: G[v]) {
+            if(dist + weight >= D[to]) continue;
+
+            D[to] = dist + weight;
+            P[to] = v;
+            buckets[D[to] % span].push_back(to);
+            pending++;
+        }
+    }
+    return visited;
+}
+
+
+// Runs body(t, begin, end) for the t-th of `threads` even slices of [0, count)
+// on its own thread, the calling thread takes slice 0.
+template<typename Body>
+void parallel_slices(size_t count, size_t threads, Body &&body) {
+    threads = std::max<size_t>(1, std::min(threads, count));
+    auto run = [&](size_t t) {
+        body(t, count * t / threads, count * (t + 1) / threads);
+    };
+
+    std::vector<std::thread> pool;
+    for(size_t t = 1; t < threads; t++)
+        pool.emplace_back(run, t);
+    run(0);
+    for(auto &thread: pool) thread.join();
+}
+
+// Builds a frozen graph from an edge list without per-edge push_back:
+// degrees are counted with atomic increments, offsets prefix-summed per
+// slice and edges scattered through atomic per-vertex cursors, each step
+// split over `threads`. Undirected edges are stored in both directions like
+// add_edge does. The order within a neighbor list is unspecified.
+Graph build_graph(bool directed, size_t vertices,
+                  std::span<const std::pair<Vertex, Vertex>> edges,
+                  size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    std::vector<size_t> offsets(vertices + 1, 0);
+    std::atomic<bool> out_of_range{false};  // workers must not throw
+
+    parallel_slices(edges.size(), threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) {
+            const auto [u, v] = edges[i];
+            if(u >= vertices || v >= vertices) {
+                out_of_range.store(true, std::memory_order_relaxed);
+                continue;
+            }
+            std::atomic_ref<size_t>(offsets[u + 1]).fetch_add(1, std::memory_order_relaxed);
+            if(!directed)
+                std::atomic_ref<size_t>(offsets[v + 1]).fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    CHECK(!out_of_range.load(), "build_graph: edge endpoint out of range [0..%zu).", vertices);
+
+    std::vector<size_t> slice_sum(threads + 1, 0);
+    parallel_slices(vertices, threads, [&](size_t t, size_t begin, size_t end) {
+        for(size_t v = begin + 1; v < end; v++)
+            offsets[v + 1] += offsets[v];
+        if(begin != end) slice_sum[t + 1] = offsets[end];
+    });
+    for(size_t t = 0; t < threads; t++)
+        slice_sum[t + 1] += slice_sum[t];
+    parallel_slices(vertices, threads, [&](size_t t, size_t begin, size_t end) {
+        const size_t before = slice_sum[t];
+        for(size_t v = begin; v < end; v++)
+            offsets[v + 1] += before;
+    });
+
+    std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+    std::vector<Vertex> targets(offsets.back());
+    parallel_slices(edges.size(), threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t i = begin; i < end; i++) {
+            const auto [u, v] = edges[i];
+            targets[std::atomic_ref<size_t>(cursor[u]).fetch_add(1, std::memory_order_relaxed)] = v;
+            if(!directed)
+                targets[std::atomic_ref<size_t>(cursor[v]).fetch_add(1, std::memory_order_relaxed)] = u;
+        }
+    });
+
+    return Graph::from_csr(directed, std::move(offsets), std::move(targets));
+}
+
+
+// Component ID of every vertex, IDs are 0..sizes.size()-1.
+struct Components {
+    std::vector<size_t> label;
+    std::vector<size_t> sizes;
+};
+
+// Root of v's tree in a concurrent union-find forest, halving the path on
+// the way. Parents only ever move towards the root, so racing halvings are
+// harmless.
+inline size_t find_root(std::vector<size_t> &parent, size_t v) {
+    while(true) {
+        std::atomic_ref<size_t> link(parent[v]);
+        size_t p = link.load(std::memory_order_relaxed);
+        const size_t gp = std::atomic_ref<size_t>(parent[p]).load(std::memory_order_relaxed);
+        if(p == gp) return p;
+
+        link.compare_exchange_weak(p, gp, std::memory_order_relaxed);
+        v = gp;
+    }
+}
+
+// Connected components of an undirected graph with a lock-free union-find:
+// every thread unites the edges of its slice of vertices, hooking the root
+// with the larger ID under the smaller one by CAS, then every vertex is
+// labeled by its root and the roots are numbered.
+Components connected_components(const Graph &G,
+                                size_t threads = std::thread::hardware_concurrency()) {
+    CHECK(!G.is_directed(), "connected_components: graph is directed.");
+    const size_t n = G.vertices();
+    std::vector<size_t> parent(n);
+
+    parallel_slices(n, threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t v = begin; v < end; v++) parent[v] = v;
+    });
+
+    parallel_slices(n, threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t v = begin; v < end; v++) {
+            for(auto neigh: G[Vertex{v}]) {
+                if(neigh >= v) continue;
+
+                size_t a = v, b = neigh;
+                while(true) {
+                    a = find_root(parent, a);
+                    b = find_root(parent, b);
+                    if(a == b) break;
+                    if(a < b) std::swap(a, b);
+
+                    size_t expected = a;
+                    if(std::atomic_ref<size_t>(parent[a]).compare_exchange_strong(
+                            expected, b, std::memory_order_relaxed))
+                        break;
+                }
+            }
+        }
+    });
+
+    Components ret;
+    ret.label.resize(n);
+    parallel_slices(n, threads, [&](size_t, size_t begin, size_t end) {
+        for(size_t v = begin; v < end; v++) ret.label[v] = find_root(parent, v);
+    });
+
+    // Roots have the smallest ID in their component, so they are numbered
+    // before any of their members is relabeled.
+    for(size_t v = 0; v < n; v++) {
+        if(ret.label[v] == v) {
+            ret.label[v] = ret.sizes.size();
+            ret.sizes.push_back(0);
+        } else {
+            ret.label[v] = ret.label[ret.label[v]];
+        }
+        ret.sizes[ret.label[v]]++;
+    }
+    return ret;
+}
+
+
+// On-disk CSR graph in native byte order: GraphFileHeader, offsets[vertices
+// + 1], targets[edges] and, with GRAPH_FILE_REVERSE, the same two arrays of
+// the transposed graph. Every section consists of 8-byte words, so a mapped
+// file is served in place and shared between processes via the page cache.
+struct GraphFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t vertices;
+    uint64_t edges;
+};
+
+constexpr char GRAPH_FILE_MAGIC[8] = {'A', 'G', '1', 'C', 'S', 'R', 0, 0};
+constexpr uint32_t GRAPH_FILE_VERSION = 1;
+enum : uint32_t { GRAPH_FILE_DIRECTED = 1, GRAPH_FILE_REVERSE = 2 };
+
+static_assert(sizeof(Vertex) == sizeof(uint64_t) && sizeof(size_t) == sizeof(uint64_t));
+
+void write_csr(std::ofstream &out, const Graph &G) {
+    auto offsets = G.csr_offsets();
+    auto targets = G.csr_targets();
+    out.write(reinterpret_cast<const char *>(offsets.data()), offsets.size_bytes());
+    out.write(reinterpret_cast<const char *>(targets.data()), targets.size_bytes());
+}
+
+// Writes G to path, with its transpose if with_reverse is set.
+void save_graph(const Graph &G, const std::string &path, bool with_reverse = false) {
+    Graph frozen = G;
+    frozen.freeze();
+
+    GraphFileHeader header{};
+    std::memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof header.magic);
+    header.version = GRAPH_FILE_VERSION;
+    header.flags = G.is_directed() ? GRAPH_FILE_DIRECTED : 0;
+    header.vertices = frozen.vertices();
+    header.edges = frozen.edges();
+    if(with_reverse && G.is_directed()) header.flags |= GRAPH_FILE_REVERSE;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof header);
+    write_csr(out, frozen);
+    if(header.flags & GRAPH_FILE_REVERSE)
+        write_csr(out, frozen.reversed());
+
+    if(!out.flush())
+        throw std::runtime_error("save_graph: cannot write " + path);
+}
+
+struct MappedGraph {
+    Graph graph;
+    std::optional<Graph> reversed;  // if the file stores the transpose
+};
+
+// Maps a file written by save_graph read-only. Nothing is copied and only
+// the header and the ends of the offsets array are checked, so opening is
+// O(1). For untrusted files pass verify to also scan the CSR arrays once,
+// so that a corrupt file throws instead of yielding a graph that reads
+// outside the mapping. The mapping lives as long as any graph using it.
+MappedGraph map_graph(const std::string &path, bool verify = false) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::system_error(errno, std::generic_category(), "map_graph: " + path);
+
+    struct stat st{};
+    if(fstat(fd, &st) < 0) {
+        const int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "map_graph: " + path);
+    }
+
+    const size_t size = st.st_size;
+    void *addr = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    const int err = errno;
+    close(fd);
+    if(addr == MAP_FAILED)
+        throw std::system_error(size ? err : EINVAL, std::generic_category(), "map_graph: " + path);
+
+    std::shared_ptr<const void> mapping(addr, [size](const void *p) {
+        munmap(const_cast<void *>(p), size);
+    });
+
+    const auto *header = static_cast<const GraphFileHeader *>(addr);
+    if(size < sizeof *header || std::memcmp(header->magic, GRAPH_FILE_MAGIC, sizeof header->magic)
+       || header->version != GRAPH_FILE_VERSION)
+        throw std::runtime_error("map_graph: " + path + " is not a graph file");
+
+    const size_t n = header->vertices, m = header->edges;
+    const size_t sections = header->flags & GRAPH_FILE_REVERSE ? 2 : 1;
+    const size_t capacity = (size - sizeof *header) / sizeof(uint64_t);
+    if(n >= capacity || m > capacity
+       || size != sizeof *header + sections * (n + 1 + m) * sizeof(uint64_t))
+        throw std::runtime_error("map_graph: " + path + " is truncated");
+
+    const bool directed = header->flags & GRAPH_FILE_DIRECTED;
+    auto words = reinterpret_cast<const size_t *>(header + 1);
+    auto section = [&]() {
+        std::span<const size_t> offsets(words, n + 1);
+        std::span<const Vertex> targets(reinterpret_cast<const Vertex *>(words + n + 1), m);
+        words += n + 1 + m;
+
+        bool valid = offsets[0] == 0 && offsets[n] == m;
+        for(size_t v = 0; verify && valid && v < n; v++) valid = offsets[v] <= offsets[v + 1];
+        for(size_t i = 0; verify && valid && i < m; i++) valid = targets[i] < n;
+        if(!valid)
+            throw std::runtime_error("map_graph: " + path + " has corrupt CSR arrays");
+
+        return Graph::from_view(directed, offsets, targets, mapping);
+    };
+
+    MappedGraph ret{section(), std::nullopt};
+    if(sections == 2) ret.reversed = section();
+    return ret;
+}
+
+
+#ifndef __PROGTEST__
+
+const Graph SMALL_GRAPHS[] = {
+  { false, { {1}, {2}, {3}, {4}, {} } },
+  { false, { {1}, {2}, {3}, {4}, {0} } },
+  { false, { {1}, {2, 4}, {3}, {4}, {}, {} } },
+  { false, { {1}, {2, 5}, {3}, {4}, {}, {} } },
+  { false, { {1}, {2, 5}, {3}, {4}, {0}, {4} }},
+  { true, { {1}, {2}, {3}, {4}, {} } },
+  { true, { {1}, {2}, {3}, {4}, {0} } },
+  { true, { {1}, {2, 4}, {3}, {4}, {}, {} } },
+  { true, { {1}, {2, 5}, {3}, {4}, {}, {} } },
+  { true, { {1}, {2, 5}, {3}, {4}, {0}, {4} }},
+};
+
+struct RandomGraphGenerator {
+  RandomGraphGenerator(uint32_t seed) : my_rand(seed) {}
+
+  uint32_t num(uint32_t max) { return my_rand() % max; }
+  Vertex vertex(const Graph& G) { return Vertex{num(G.vertices())}; }
+
+  Graph graph1(uint32_t s, size_t edges, bool directed = true) {
+    Graph G(directed, s);
+
+    while (edges--) {
+      auto u = vertex(G);
+      auto v = vertex(G);
+      G.add_edge(u, v);
+    }
+
+    return G;
+  }
+
+  Graph graph2(uint32_t s, double density, bool directed = true) {
+    Graph G(directed, s);
+
+    for (Vertex u : G) for (Vertex v : G)
+      if (num(1'000'000'000) < 1'000'000'000*density) G.add_edge(u, v);
+
+    return G;
+  }
+
+  // Graph500 R-MAT graph with 2^scale vertices and edge_factor * 2^scale
+  // edges, vertex IDs scrambled.
+  Graph rmat(unsigned scale, size_t edge_factor, bool directed = false) {
+    const uint32_t A = 570'000'000, B = 190'000'000, C = 190'000'000;
+    const size_t n = size_t(1) << scale;
+    Graph G(directed, n);
+
+    std::vector<Vertex> perm(n);
+    for (size_t i = 0; i < n; i++) perm[i] = Vertex{i};
+    std::shuffle(perm.begin(), perm.end(), my_rand);
+
+    for (size_t e = 0; e < edge_factor * n; e++) {
+      size_t u = 0, v = 0;
+      for (unsigned bit = 0; bit < scale; bit++) {
+        uint32_t r = num(1'000'000'000);
+        u = 2*u + (r >= A + B);
+        v = 2*v + ((r >= A && r < A + B) || r >= A + B + C);
+      }
+      G.add_edge(perm[u], perm[v]);
+    }
+
+    return G;
+  }
+
+  WeightedGraph weighted(uint32_t s, size_t edges, uint32_t max_weight, bool directed = true) {
+    WeightedGraph G(directed, s);
+
+    while (edges--) {
+      auto u = Vertex{num(s)};
+      auto v = Vertex{num(s)};
+      G.add_edge(u, v, num(max_weight + 1));
+    }
+
+    return G;
+  }
+
+  private:
+  std::mt19937 my_rand;
+};
+
+
+bool is_dense(const Graph& G) { return 64 * G.edges() >= G.vertices() * G.vertices(); }
+
+// Copy of G over 32-bit IDs, frozen iff G is.
+Graph32 to_graph32(const Graph& G) {
+  Graph32 H(G.is_directed(), G.vertices());
+  for (Vertex u : G) for (Vertex v : G[u])
+    if (G.is_directed() || u <= v) H.add_edge(Vertex32(u), Vertex32(v));
+  if (G.is_frozen()) H.freeze();
+  return H;
+}
+
+// BFS from one root on the graph a runner was prepared for. The benchmark
+// times only `traverse`; `finish`, if set, then moves the result into P and
+// D in G's labels. `debug_begin` and `debug_end` are set if traverse reads a
+// graph other than G, whose single-scan check they then switch.
+struct BfsRunner {
+  std::function<size_t(Vertex, std::vector<Vertex>&, std::vector<size_t>&)> traverse;
+  std::function<void(std::vector<Vertex>&, std::vector<size_t>&)> finish = {};
+  std::function<void()> debug_begin = {}, debug_end = {};
+};
+
+// Per-graph setup of a variant (relabeling, encoding, ...), done once so that
+// the tests and the benchmark pay only for the traversals.
+using BfsPrepare = BfsRunner (*)(const Graph&);
+
+struct BfsVariant {
+  const char *name;
+  BfsPrepare prepare;
+  bool single_scan;  // examines each adjacency list at most once
+  bool dense_only = false;  // run only where a bit matrix beats the lists
+  bool sampled = false;  // preparation too costly for every big test graph
+};
+
+// Runner of a variant that relabels G by `order` and answers in the old labels.
+template<Relabeling (*order)(const Graph&)>
+BfsRunner relabeled_runner(const Graph& G) {
+  auto r = std::make_shared<const Relabeling>(order(G));
+  auto H = std::make_shared<const Graph>(relabel(G, *r));
+  return {
+    [r, H](Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+      return bfs(*H, r->new_id[u], P, D);
+    },
+    [r](std::vector<Vertex>& P, std::vector<size_t>& D) { restore_labels(*r, P, D); } };
+}
+
+const BfsVariant BFS_VARIANTS[] = {
+  { "bfs", [](const Graph& G) -> BfsRunner {
+      return { [&G](Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+        return bfs(G, u, P, D);
+      } };
+    }, true },
+  { "bfs_hybrid", [](const Graph& G) -> BfsRunner {
+      G.transposed();
+      return { [&G](Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+        return bfs_hybrid(G, u, P, D);
+      } };
+    }, false },
+  { "bfs_parallel", [](const Graph& G) -> BfsRunner {
+      return { [&G](Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+        return bfs_parallel(G, u, P, D, 4);
+      } };
+    }, false },
+  { "BfsWorkspace", [](const Graph& G) -> BfsRunner {
+      auto ws = std::make_shared<BfsWorkspace>(G.vertices());
+      return {
+        [&G, ws](Vertex u, std::vector<Vertex>&, std::vector<size_t>&) {
+          return ws->run(G, u);
+        },
+        [ws](std::vector<Vertex>& P, std::vector<size_t>& D) {
+          for (Vertex v : ws->order()) {
+            P[v] = ws->pred(v);
+            D[v] = ws->dist(v);
+          }
+        } };
+    }, true },
+  { "rcm_order", relabeled_runner<rcm_order>, false, false, true },
+  { "CompressedGraph", [](const Graph& G) -> BfsRunner {
+      auto H = std::make_shared<const CompressedGraph>(G);
+      return { [H](Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+        return bfs(*H, u, P, D);
+      } };
+    }, true, false, true },
+  { "DenseGraph", [](const Graph& G) -> BfsRunner {
+      auto H = std::make_shared<const DenseGraph>(G);
+      return { [H](Vertex u, std::vector<Vertex>& P, std::vector<size_t>& D) {
+        return bfs_dense(*H, u, P, D);
+      } };
+    }, true, true },
+  { "degree_order", relabeled_runner<degree_order>, false, false, true },
+  { "Graph32", [](const Graph& G) -> BfsRunner {
+      // The 32-bit result of a traversal, reset by finish for the next one.
+      struct Result {
+        std::vector<Vertex32> P;
+        std::vector<uint32_t> D;
+      };
+      auto H = std::make_shared<const Graph32>(to_graph32(G));
+      auto res = std::make_shared<Result>(Result{
+        std::vector<Vertex32>(H->vertices(), no_vertex<Vertex32>),
+        std::vector<uint32_t>(H->vertices(), no_distance<Vertex32>) });
+      return {
+        [H, res](Vertex u, std::vector<Vertex>&, std::vector<size_t>&) {
+          return bfs(*H, Vertex32(u), res->P, res->D);
+        },
+        [res](std::vector<Vertex>& P, std::vector<size_t>& D) {
+          for (size_t v = 0; v < res->P.size(); v++) {
+            if (res->P[v] == no_vertex<Vertex32>) continue;
+            P[v] = res->P[v] == root_vertex<Vertex32> ? ROOT : Vertex{res->P[v]};
+            D[v] = res->D[v];
+            res->P[v] = no_vertex<Vertex32>;
+            res->D[v] = no_distance<Vertex32>;
+          }
+        },
+        [H] { H->bfs_debug_begin(); },
+        [H] { H->bfs_debug_end(); } };
+    }, true, false, true },
+};
+
+void verify_bfs(const Graph& G, Vertex u, const std::vector<Vertex>& P,
+                const std::vector<size_t>& D, size_t seen_t) {
+  std::vector<bool> pred_ok(G.vertices(), false);
+
+  CHECK(P[u] == ROOT, "P[u] != ROOT but %zu.", size_t(P[u]));
+  CHECK(D[u] == 0, "D[u] != 0 but %zu.", D[u]);
+  pred_ok[u] = true;
+
+  for (Vertex v : G) {
+    if (P[v] == NO_VERTEX) {
+      CHECK(D[v] == NO_DISTANCE, "P[%zu] == NO_VERTEX but D[%u] == %zu not NO_DISTANCE.",
+        size_t(v), size_t(v), D[v]);
+
+      pred_ok[v] = true;
+      continue;
+    }
+
+    if (v != u) {
+      CHECK(P[v] < G.vertices(),
+        "P[%zu] == %zu >= %zu (# of vertices).", size_t(v), size_t(P[v]), G.vertices());
+      CHECK(P[P[v]] != NO_VERTEX,
+        "P[%zu] == %zu but P[%zu] == NO_VERTEX.", size_t(v), size_t(P[v]), size_t(P[v]));
+    }
+    
+
+    for (Vertex w : G[v]) {
+      CHECK(D[w] <= D[v] + 1, "D[%zu] == %zu but its neighbor has D[%zu] == %zu.",
+        size_t(w), D[w], size_t(v), D[v]);
+    
+      if (P[w] != v) continue;
+
+      CHECK(D[w] == D[v] + 1, "P[%zu] == %zu but D[%zu] == %zu != D[%zu] + 1 == %zu",
+        size_t(w), size_t(v), size_t(w), D[w], size_t(v), 1 + D[v]);
+      pred_ok[w] = true;
+    }
+  }
+
+  size_t seen_r = 0;
+  for (Vertex v : G) {
+    CHECK(pred_ok[v], "P[%zu] == %zu but there is no edge.", size_t(v), size_t(P[v]));
+    seen_r += (P[v] != NO_VERTEX);
+  }
+
+  CHECK(seen_r == seen_t,
+    "Reported size of component is %zu but it should be %zu.", seen_t, seen_r);
+}
+
+void test_bfs_inner(const Graph& G, Vertex u, const BfsRunner& run, bool single_scan) {
+  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+
+  if (single_scan) run.debug_begin ? run.debug_begin() : G.bfs_debug_begin();
+  size_t seen_t = run.traverse(u, P, D);
+  run.debug_end ? run.debug_end() : G.bfs_debug_end();
+  if (run.finish) run.finish(P, D);
+
+  verify_bfs(G, u, P, D, seen_t);
+}
+
+void test_reversed_inner(const Graph& G) {
+  Graph RG = G.reversed();
+  CHECK(RG.is_frozen() == G.is_frozen(), "Reversed graph changed storage.");
+  CHECK(RG.edges() == G.edges(),
+    "Reversed graph has %zu edges but should have %zu.", RG.edges(), G.edges());
+
+  std::vector<size_t> out(G.vertices()), in(G.vertices());
+  for (Vertex v : G) for (Vertex w : G[v]) out[w] += v + 1;
+  for (Vertex w : RG) for (Vertex v : RG[w]) in[w] += v + 1;
+  for (Vertex v : G) CHECK(out[v] == in[v],
+    "Reversed graph has wrong predecessors of %zu.", size_t(v));
+
+  const Graph& T = G.transposed();
+  CHECK(&G.transposed() == &T, "Transpose was built twice.");
+  CHECK(T.edges() == G.edges() && T.is_directed() == G.is_directed(),
+    "Transpose has %zu edges but should have %zu.", T.edges(), G.edges());
+  for (Vertex v : G) {
+    auto a = RG[v], b = T[v];
+    CHECK(std::equal(a.begin(), a.end(), b.begin(), b.end()),
+      "Transpose has different predecessors of %zu.", size_t(v));
+  }
+
+  Graph C = G;
+  C.transposed();
+  C.freeze();
+  CHECK(C.transposed().is_frozen(), "Transpose was not rebuilt after freeze.");
+}
+
+// Every variant from every root, on G and on a frozen copy. Variants are
+// prepared once per graph; sampled ones and the transpose checks run only
+// if `all_variants`.
+void test_bfs(const Graph& G, const std::vector<Vertex>& roots, bool all_variants = true) {
+  Graph F = G;
+  F.freeze();
+
+  for (const Graph* H : { &G, &std::as_const(F) }) {
+    for (const BfsVariant& impl : BFS_VARIANTS) {
+      if (impl.dense_only && !is_dense(*H)) continue;
+      if (impl.sampled && !all_variants) continue;
+      const BfsRunner run = impl.prepare(*H);
+
+      for (Vertex u : roots) try {
+        test_bfs_inner(*H, u, run, impl.single_scan);
+      } catch (const TestFailed& e) {
+        H->bfs_debug_end();
+        std::cout << "Test failed (" << impl.name << "): v = " << u
+                  << ", G = " << *H << "\n" << e.what() << std::endl;
+        throw;
+      }
+    }
+
+    if (all_variants) try {
+      test_reversed_inner(*H);
+    } catch (const TestFailed& e) {
+      std::cout << "Test failed (reversed): G = " << *H << "\n"
+                << e.what() << std::endl;
+      throw;
+    }
+  }
+}
+
+
+template<size_t Words>
+void test_bfs_multi_inner(const Graph& G, const std::vector<Vertex>& sources) {
+  auto D = bfs_multi<Words>(G, sources);
+  CHECK(D.size() == sources.size(),
+    "bfs_multi returned %zu rows for %zu sources.", D.size(), sources.size());
+
+  for (size_t i = 0; i < sources.size(); i++) {
+    std::vector<Vertex> P_ref(G.vertices(), NO_VERTEX);
+    std::vector<size_t> D_ref(G.vertices(), NO_DISTANCE);
+    bfs(G, sources[i], P_ref, D_ref);
+
+    for (Vertex v : G) CHECK(D[i][v] == D_ref[v],
+      "bfs_multi: distance from %zu to %zu is %zu but should be %zu.",
+      size_t(sources[i]), size_t(v), D[i][v], D_ref[v]);
+  }
+}
+
+template<size_t Words>
+void test_bfs_multi(const Graph& G, const std::vector<Vertex>& sources) {
+  try {
+    test_bfs_multi_inner<Words>(G, sources);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (bfs_multi<" << Words << ">): G = " << G << "\n"
+              << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_shortest_path_inner(const Graph& G, const Graph& RG, Vertex s, Vertex t) {
+  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+  bfs(G, s, P, D);
+
+  auto [ length, path ] = shortest_path(G, RG, s, t);
+  CHECK(length == D[t], "Path from %zu to %zu has length %zu but should have %zu.",
+    size_t(s), size_t(t), length, D[t]);
+  if (length == NO_DISTANCE) {
+    CHECK(path.empty(), "Unreachable vertex %zu has a path.", size_t(t));
+    return;
+  }
+
+  CHECK(path.size() == length + 1,
+    "Path of length %zu has %zu vertices.", length, path.size());
+  CHECK(path.front() == s && path.back() == t, "Path does not go from %zu to %zu.",
+    size_t(s), size_t(t));
+  for (size_t i = 1; i < path.size(); i++) {
+    auto adj = G[path[i - 1]];
+    CHECK(std::find(adj.begin(), adj.end(), path[i]) != adj.end(),
+      "Path uses missing edge %zu --> %zu.", size_t(path[i - 1]), size_t(path[i]));
+  }
+}
+
+void test_shortest_path(const Graph& G, const Graph& RG, Vertex s, Vertex t) {
+  try {
+    test_shortest_path_inner(G, RG, s, t);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (shortest_path): s = " << s << ", t = " << t
+              << ", G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_mapped_graph(const Graph& G, Vertex u) {
+  const auto path = std::filesystem::temp_directory_path() / "ag1_bfs_test.graph";
+  save_graph(G, path, true);
+  MappedGraph mapped = map_graph(path, true);
+  std::filesystem::remove(path);
+
+  try {
+    CHECK(mapped.graph.is_frozen() && mapped.graph.is_directed() == G.is_directed(),
+      "Mapped graph has wrong flags.");
+    CHECK(mapped.graph.vertices() == G.vertices() && mapped.graph.edges() == G.edges(),
+      "Mapped graph has %zu vertices and %zu edges instead of %zu and %zu.",
+      mapped.graph.vertices(), mapped.graph.edges(), G.vertices(), G.edges());
+    CHECK(mapped.reversed.has_value() == G.is_directed(),
+      "Mapped graph should %sstore its transpose.", G.is_directed() ? "" : "not ");
+
+    for (Vertex v : G) {
+      auto a = G[v], b = mapped.graph[v];
+      CHECK(std::equal(a.begin(), a.end(), b.begin(), b.end()),
+        "Mapped graph has different neighbors of %zu.", size_t(v));
+    }
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (map_graph): G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+
+  test_bfs(mapped.graph, { u });
+  if (mapped.reversed)
+    test_shortest_path(mapped.graph, *mapped.reversed, u, Vertex{G.vertices() - 1 - u});
+}
+
+void test_build_graph_inner(const Graph& G, const std::vector<std::pair<Vertex, Vertex>>& edges) {
+  Graph B = build_graph(G.is_directed(), G.vertices(), edges, 4);
+  CHECK(B.is_frozen() && B.is_directed() == G.is_directed(), "Built graph has wrong flags.");
+  CHECK(B.vertices() == G.vertices() && B.edges() == G.edges(),
+    "Built graph has %zu vertices and %zu edges instead of %zu and %zu.",
+    B.vertices(), B.edges(), G.vertices(), G.edges());
+
+  std::vector<Vertex> a, b;
+  for (Vertex v : G) {
+    auto ga = G[v], gb = B[v];
+    a.assign(ga.begin(), ga.end());
+    b.assign(gb.begin(), gb.end());
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+    CHECK(a == b, "Built graph has different neighbors of %zu.", size_t(v));
+  }
+
+  auto bad = edges;
+  bad.emplace_back(Vertex{0}, Vertex{G.vertices()});
+  bool rejected = false;
+  try {
+    build_graph(G.is_directed(), G.vertices(), bad, 4);
+  } catch (const TestFailed&) {
+    rejected = true;
+  }
+  CHECK(rejected, "Edge to vertex %zu was accepted.", G.vertices());
+}
+
+void test_build_graph(const Graph& G, const std::vector<std::pair<Vertex, Vertex>>& edges) {
+  try {
+    test_build_graph_inner(G, edges);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (build_graph): G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+using WeightedImpl = size_t (*)(const WeightedGraph&, Vertex, std::vector<Vertex>&, std::vector<size_t>&);
+
+void test_weighted_inner(const WeightedGraph& G, Vertex u, WeightedImpl impl) {
+  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+  size_t seen_t = impl(G, u, P, D);
+
+  std::vector<size_t> D_ref(G.vertices(), NO_DISTANCE);
+  using Item = std::pair<size_t, Vertex>;
+  std::priority_queue<Item, std::vector<Item>, std::greater<>> heap;
+  heap.emplace(D_ref[u] = 0, u);
+  while (!heap.empty()) {
+    auto [ d, v ] = heap.top();
+    heap.pop();
+    if (d != D_ref[v]) continue;
+    for (auto [ w, c ] : G[v]) if (d + c < D_ref[w]) heap.emplace(D_ref[w] = d + c, w);
+  }
+
+  CHECK(P[u] == ROOT, "P[u] != ROOT but %zu.", size_t(P[u]));
+  size_t seen_r = 0;
+  for (Vertex v : G) {
+    CHECK(D[v] == D_ref[v], "D[%zu] == %zu but should be %zu.", size_t(v), D[v], D_ref[v]);
+    if (D[v] == NO_DISTANCE) {
+      CHECK(P[v] == NO_VERTEX, "Unreachable %zu has P == %zu.", size_t(v), size_t(P[v]));
+      continue;
+    }
+
+    seen_r++;
+    if (v == u) continue;
+    CHECK(P[v] < G.vertices(), "P[%zu] == %zu is not a vertex.", size_t(v), size_t(P[v]));
+    bool edge_ok = false;
+    for (auto [ w, c ] : G[P[v]]) edge_ok |= w == v && D[P[v]] + c == D[v];
+    CHECK(edge_ok, "P[%zu] == %zu but no edge of weight D[%zu] - D[%zu].",
+      size_t(v), size_t(P[v]), size_t(v), size_t(P[v]));
+  }
+
+  CHECK(seen_r == seen_t,
+    "Reported size of component is %zu but it should be %zu.", seen_t, seen_r);
+}
+
+void test_weighted(const WeightedGraph& G, Vertex u, const char *name, WeightedImpl impl) {
+  try {
+    test_weighted_inner(G, u, impl);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (" << name << "): v = " << u << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_components_inner(const Graph& G) {
+  Components C = connected_components(G, 4);
+  CHECK(C.label.size() == G.vertices(), "Components label %zu of %zu vertices.",
+    C.label.size(), G.vertices());
+
+  BfsWorkspace ws;
+  std::vector<size_t> bfs_label(G.vertices(), NO_VERTEX);
+  std::vector<size_t> sizes;
+  for (Vertex v : G) {
+    if (bfs_label[v] != NO_VERTEX) continue;
+    sizes.push_back(ws.run(G, v));
+    for (Vertex w : ws.order()) bfs_label[w] = sizes.size() - 1;
+  }
+
+  CHECK(C.sizes.size() == sizes.size(), "Found %zu components but there are %zu.",
+    C.sizes.size(), sizes.size());
+
+  std::vector<size_t> to_bfs(sizes.size(), NO_VERTEX);
+  for (Vertex v : G) {
+    size_t c = C.label[v];
+    CHECK(c < sizes.size(), "Vertex %zu has label %zu out of range.", size_t(v), c);
+    if (to_bfs[c] == NO_VERTEX) to_bfs[c] = bfs_label[v];
+    CHECK(to_bfs[c] == bfs_label[v], "Vertex %zu is in a wrong component.", size_t(v));
+  }
+  for (size_t c = 0; c < sizes.size(); c++) CHECK(C.sizes[c] == sizes[to_bfs[c]],
+    "Component %zu has size %zu but should have %zu.", c, C.sizes[c], sizes[to_bfs[c]]);
+}
+
+void test_components(const Graph& G) {
+  try {
+    test_components_inner(G);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (connected_components): G = " << G << "\n"
+              << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_bounded_bfs_inner(const Graph& G, Vertex u, Vertex t, size_t max_depth) {
+  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+  bfs(G, u, P, D);
+
+  struct LevelCounter : BfsVisitor {
+    std::vector<size_t> levels;
+    Visit level_end(size_t dist) { levels.push_back(dist); return Visit::CONTINUE; }
+  } counter;
+
+  BfsWorkspace ws;
+  size_t seen = ws.run(G, u, max_depth, counter);
+  size_t seen_r = 0;
+  for (Vertex v : G) {
+    bool near = D[v] <= max_depth;
+    seen_r += near;
+    CHECK(ws.dist(v) == (near ? D[v] : NO_DISTANCE),
+      "Bounded BFS: D[%zu] == %zu but should be %zu.", size_t(v), ws.dist(v), D[v]);
+  }
+  CHECK(seen == seen_r, "Bounded BFS reached %zu vertices instead of %zu.", seen, seen_r);
+  for (size_t d = 0; d < counter.levels.size(); d++)
+    CHECK(counter.levels[d] == d, "Level %zu ended as level %zu.", d, counter.levels[d]);
+
+  struct FindTarget : BfsVisitor {
+    Vertex target;
+    Visit discover(Vertex v, Vertex, size_t) {
+      return v == target ? Visit::STOP : Visit::CONTINUE;
+    }
+  };
+
+  seen = ws.run(G, u, NO_DISTANCE, FindTarget{ {}, t });
+  CHECK(ws.dist(t) == D[t], "Early stop: D[%zu] == %zu but should be %zu.",
+    size_t(t), ws.dist(t), D[t]);
+  if (D[t] == NO_DISTANCE) return;
+
+  CHECK(ws.order().back() == t, "Search went on after reaching %zu.", size_t(t));
+  for (Vertex v : ws.order()) CHECK(D[v] <= D[t],
+    "Search reached %zu at distance %zu beyond the target at %zu.", size_t(v), D[v], D[t]);
+}
+
+void test_bounded_bfs(const Graph& G, Vertex u, Vertex t, size_t max_depth) {
+  try {
+    test_bounded_bfs_inner(G, u, t, max_depth);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (bounded BFS): u = " << u << ", t = " << t
+              << ", k = " << max_depth << ", G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_dynamic_bfs(Graph G, Vertex root, RandomGraphGenerator& rgg,
+                      size_t batches, size_t batch) {
+  DynamicBfs dyn(G, root);
+
+  for (size_t b = 0; b < batches; b++) {
+    for (size_t i = 0; i < batch; i++) dyn.add_edge(rgg.vertex(G), rgg.vertex(G));
+
+    try {
+      verify_bfs(G, root, dyn.P(), dyn.D(), dyn.visited());
+
+      std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+      std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+      bfs(G, root, P, D);
+      CHECK(D == dyn.D(), "Maintained distances differ from a fresh BFS.");
+    } catch (const TestFailed& e) {
+      std::cout << "Test failed (DynamicBfs): v = " << root << ", G = " << G << "\n"
+                << e.what() << std::endl;
+      throw;
+    }
+  }
+}
+
+// Grid of w x h cells where about a third are walls, moves go to the four
+// adjacent free cells.
+struct TestGrid {
+  size_t w, h;
+  std::vector<bool> wall;
+
+  bool free(size_t x, size_t y) const { return x < w && y < h && !wall[y * w + x]; }
+
+  template<typename Emit>
+  void neighbors(std::pair<size_t, size_t> s, Emit&& emit) const {
+    auto [ x, y ] = s;
+    if (free(x + 1, y)) emit(std::pair{ x + 1, y });
+    if (free(x - 1, y)) emit(std::pair{ x - 1, y });
+    if (free(x, y + 1)) emit(std::pair{ x, y + 1 });
+    if (free(x, y - 1)) emit(std::pair{ x, y - 1 });
+  }
+
+  Graph materialize() const {
+    Graph G(true, w * h);
+    for (size_t y = 0; y < h; y++) for (size_t x = 0; x < w; x++) if (free(x, y))
+      neighbors({ x, y }, [&](std::pair<size_t, size_t> t) {
+        G.add_edge(Vertex{y * w + x}, Vertex{t.second * w + t.first});
+      });
+    return G;
+  }
+};
+
+struct PairHash {
+  size_t operator () (std::pair<size_t, size_t> p) const { return p.first * 0x9e3779b97f4a7c15 ^ p.second; }
+};
+
+void test_implicit_bfs_inner(const TestGrid& grid, std::pair<size_t, size_t> start, size_t k) {
+  Graph G = grid.materialize();
+  auto index = [&](std::pair<size_t, size_t> s) { return s.second * grid.w + s.first; };
+  auto neighbors = [&](std::pair<size_t, size_t> s, auto&& emit) { grid.neighbors(s, emit); };
+
+  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+  size_t seen = implicit_bfs(start, index, neighbors, P, D);
+  verify_bfs(G, Vertex{index(start)}, P, D, seen);
+
+  auto near = implicit_bfs<std::pair<size_t, size_t>, PairHash>(start, neighbors, k);
+  size_t near_r = 0;
+  for (Vertex v : G) near_r += D[v] <= k;
+  CHECK(near.size() == near_r, "Hashed implicit BFS found %zu states instead of %zu.",
+    near.size(), near_r);
+  for (auto& [ s, visit ] : near) CHECK(visit.dist == D[index(s)],
+    "Hashed implicit BFS: distance of %zu is %zu but should be %zu.",
+    index(s), visit.dist, D[index(s)]);
+}
+
+void test_implicit_bfs(const TestGrid& grid, std::pair<size_t, size_t> start, size_t k) {
+  try {
+    test_implicit_bfs_inner(grid, start, k);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (implicit_bfs): " << grid.w << "x" << grid.h << " grid\n"
+              << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_bfs_stream_inner(const Graph& G, Vertex u, size_t limit) {
+  std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+
+  size_t taken = 0;
+  size_t last_dist = 0;
+  for (const BfsItem& item : bfs_stream(G, u)) {
+    CHECK(item.dist >= last_dist, "Stream went from distance %zu back to %zu.",
+      last_dist, item.dist);
+    CHECK(P[item.vertex] == NO_VERTEX, "Vertex %zu streamed twice.", size_t(item.vertex));
+    if (item.pred != ROOT) CHECK(P[item.pred] != NO_VERTEX,
+      "Vertex %zu streamed before its predecessor %zu.", size_t(item.vertex), size_t(item.pred));
+
+    P[item.vertex] = item.pred;
+    D[item.vertex] = item.dist;
+    last_dist = item.dist;
+    if (++taken == limit) break;
+  }
+
+  std::vector<Vertex> P_ref(G.vertices(), NO_VERTEX);
+  std::vector<size_t> D_ref(G.vertices(), NO_DISTANCE);
+  size_t seen = bfs(G, u, P_ref, D_ref);
+  CHECK(taken == std::min(seen, limit), "Stream gave %zu vertices instead of %zu.",
+    taken, std::min(seen, limit));
+
+  if (taken == seen) return verify_bfs(G, u, P, D, seen);
+  for (Vertex v : G) if (P[v] != NO_VERTEX) CHECK(D[v] == D_ref[v],
+    "Streamed D[%zu] == %zu but should be %zu.", size_t(v), D[v], D_ref[v]);
+}
+
+void test_bfs_stream(const Graph& G, Vertex u, size_t limit) {
+  try {
+    test_bfs_stream_inner(G, u, limit);
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (bfs_stream): v = " << u << ", limit = " << limit
+              << ", G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+// map_graph must reject files whose header or CSR arrays are inconsistent.
+// The base file holds the path 0 -> 1 -> 2 -> 3 -> 4: a 32-byte header,
+// offsets at byte 32 and targets at byte 80.
+void test_corrupt_graph_files() {
+  const auto path = std::filesystem::temp_directory_path() / "ag1_bfs_corrupt.graph";
+  auto patch = [&](size_t pos, uint64_t value) {
+    save_graph(SMALL_GRAPHS[5], path);
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(pos);
+    f.write(reinterpret_cast<const char *>(&value), sizeof value);
+  };
+  auto rejected = [&]() {
+    try {
+      map_graph(path, true);
+    } catch (const TestFailed&) {
+      return false;
+    } catch (const std::runtime_error&) {
+      return true;
+    }
+    return false;
+  };
+
+  try {
+    {
+      // (n + 1) * 8 wraps around to the 32 bytes that follow the header.
+      GraphFileHeader header{};
+      std::memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof header.magic);
+      header.version = GRAPH_FILE_VERSION;
+      header.vertices = (uint64_t(1) << 61) + 3;
+      const uint64_t zeros[4] = {};
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(&header), sizeof header);
+      out.write(reinterpret_cast<const char *>(zeros), sizeof zeros);
+    }
+    CHECK(rejected(), "Overflowing vertex count was accepted.");
+
+    patch(32, 1);
+    CHECK(rejected(), "Nonzero first offset was accepted.");
+    patch(48, 4);
+    CHECK(rejected(), "Decreasing offsets were accepted.");
+    patch(80, 7);
+    CHECK(rejected(), "Target out of range was accepted.");
+    patch(80, 1);
+    CHECK(!rejected(), "Valid file was rejected.");
+  } catch (const TestFailed& e) {
+    std::filesystem::remove(path);
+    std::cout << "Test failed (map_graph): " << e.what() << std::endl;
+    throw;
+  }
+  std::filesystem::remove(path);
+}
+
+void run_tests() {
+  std::cout << "Hardcoded graphs..." << std::endl;
+  for (const Graph& G : SMALL_GRAPHS) {
+    std::vector<Vertex> roots;
+    for (Vertex u : G) roots.push_back(u);
+    test_bfs(G, roots);
+  }
+  
+  RandomGraphGenerator rgg(53323);
+  std::cout << "Small random graphs..." << std::endl;
+  for (size_t i = 0; i < 30; i++) {
+    Graph G = rgg.graph1(10 + i, 4*(10 + i));
+    Vertex u = rgg.vertex(G);
+    test_bfs(G, { u });
+  }
+  for (size_t i = 0; i < 30; i++) {
+    Graph G = rgg.graph2(10 + i, 0.7);
+    Vertex u = rgg.vertex(G);
+    test_bfs(G, { u });
+  }
+
+  std::cout << "Big random graphs..." << std::endl;
+  for (size_t i = 0; i < 20; i++) {
+    Graph G = rgg.graph1(30'000 + 50*i, 150'000 + 300*i);
+    Vertex u = rgg.vertex(G);
+    test_bfs(G, { u }, i % 5 == 0);
+  }
+  for (size_t i = 0; i < 20; i++) {
+    Graph G = rgg.graph2(900 + i, 0.7);
+    Vertex u = rgg.vertex(G);
+    test_bfs(G, { u }, i % 5 == 0);
+  }
+
+  std::cout << "Multi-source BFS..." << std::endl;
+  for (size_t i = 0; i < 6; i++) {
+    Graph G = rgg.graph1(2'000 + 50*i, 5'000 + 300*i, i % 2);
+    std::vector<Vertex> sources(70 + 40*i);
+    for (Vertex& s : sources) s = rgg.vertex(G);
+
+    test_bfs_multi<1>(G, sources);
+    test_bfs_multi<4>(G, sources);
+  }
+
+  std::cout << "Bidirectional shortest paths..." << std::endl;
+  for (const Graph& G : SMALL_GRAPHS) {
+    Graph RG = G.reversed();
+    for (Vertex s : G) for (Vertex t : G) test_shortest_path(G, RG, s, t);
+  }
+  for (size_t i = 0; i < 10; i++) {
+    Graph G = rgg.graph1(30'000 + 50*i, 40'000 + 300*i, i % 2);
+    Graph RG = G.reversed();
+    for (size_t j = 0; j < 10; j++)
+      test_shortest_path(G, RG, rgg.vertex(G), rgg.vertex(G));
+  }
+
+  std::cout << "Mapped graph files..." << std::endl;
+  test_corrupt_graph_files();
+  for (size_t i = 0; i < 4; i++) {
+    Graph G = rgg.graph1(5'000 + 50*i, 20'000 + 300*i, i % 2);
+    test_mapped_graph(G, rgg.vertex(G));
+  }
+
+  std::cout << "Parallel edge-list ingestion..." << std::endl;
+  for (size_t i = 0; i < 6; i++) {
+    Graph G(i % 2, 3 + 5'000*i);
+    std::vector<std::pair<Vertex, Vertex>> edges(20'000*i);
+    for (auto& [u, v] : edges) {
+      u = rgg.vertex(G);
+      v = rgg.vertex(G);
+      G.add_edge(u, v);
+    }
+
+    test_build_graph(G, edges);
+  }
+
+  std::cout << "Small integer weights..." << std::endl;
+  for (size_t i = 0; i < 10; i++) {
+    WeightedGraph G01 = rgg.weighted(10 + 3'000*i, 40 + 10'000*i, 1, i % 2);
+    test_weighted(G01, Vertex{rgg.num(G01.vertices())}, "bfs_01", bfs_01);
+    test_weighted(G01, Vertex{rgg.num(G01.vertices())}, "dial", dial);
+
+    WeightedGraph G = rgg.weighted(10 + 3'000*i, 40 + 10'000*i, 1 + i, i % 2);
+    test_weighted(G, Vertex{rgg.num(G.vertices())}, "dial", dial);
+  }
+
+  std::cout << "Connected components..." << std::endl;
+  for (const Graph& G : SMALL_GRAPHS) if (!G.is_directed()) test_components(G);
+  for (size_t i = 0; i < 10; i++)
+    test_components(rgg.graph1(10 + 10'000*i, 4'000*i, false));
+
+  std::cout << "Bounded BFS with visitors..." << std::endl;
+  for (size_t i = 0; i < 20; i++) {
+    Graph G = rgg.graph1(10 + 1'000*i, 40 + 3'000*i, i % 2);
+    test_bounded_bfs(G, rgg.vertex(G), rgg.vertex(G), i % 4);
+  }
+
+  std::cout << "Incremental BFS..." << std::endl;
+  for (size_t i = 0; i < 10; i++) {
+    Graph G = rgg.graph1(10 + 2'000*i, 5 + 1'000*i, i % 2);
+    test_dynamic_bfs(G, rgg.vertex(G), rgg, 20, 1 + 100*i);
+  }
+
+  std::cout << "Implicit graphs..." << std::endl;
+  for (size_t i = 0; i < 10; i++) {
+    TestGrid grid{ 5 + 20*i, 3 + 30*i, {} };
+    grid.wall.resize(grid.w * grid.h);
+    for (size_t c = 0; c < grid.wall.size(); c++) grid.wall[c] = rgg.num(3) == 0;
+
+    std::pair<size_t, size_t> start{ rgg.num(grid.w), rgg.num(grid.h) };
+    grid.wall[start.second * grid.w + start.first] = false;
+    test_implicit_bfs(grid, start, 3 * i);
+  }
+
+  std::cout << "Lazy BFS streams..." << std::endl;
+  for (const Graph& G : SMALL_GRAPHS) for (Vertex u : G) test_bfs_stream(G, u, NO_VERTEX);
+  for (size_t i = 0; i < 10; i++) {
+    Graph G = rgg.graph1(10 + 3'000*i, 40 + 12'000*i, i % 2);
+    test_bfs_stream(G, rgg.vertex(G), i % 2 ? NO_VERTEX : 1 + 500*i);
+  }
+}
+
+double quantile(const std::vector<double>& sorted, double q) {
+  double pos = q * (sorted.size() - 1);
+  size_t i = size_t(pos);
+  if (i + 1 >= sorted.size()) return sorted.back();
+  return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+// Graph500-style run: every BFS variant from the same roots, each result
+// validated, traversed edges per second reported as quartiles. Neither the
+// per-graph preparation nor moving a result back to G's labels is timed.
+// Traversed edges are the edges of the visited vertices, each undirected
+// edge counted once.
+void bench_graph(const char *family, const Graph& G, const std::vector<Vertex>& sources) {
+  std::cout << family << ": " << G.vertices() << " vertices, " << G.edges()
+            << " edges, " << sources.size() << " roots" << std::endl;
+
+  for (const BfsVariant& impl : BFS_VARIANTS) {
+    if (impl.dense_only && !is_dense(G)) continue;
+    const BfsRunner run = impl.prepare(G);
+
+    std::vector<double> teps;
+    for (Vertex u : sources) {
+      std::vector<Vertex> P(G.vertices(), NO_VERTEX);
+      std::vector<size_t> D(G.vertices(), NO_DISTANCE);
+
+      auto start = std::chrono::steady_clock::now();
+      size_t seen = run.traverse(u, P, D);
+      std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+      if (run.finish) run.finish(P, D);
+
+      try {
+        verify_bfs(G, u, P, D, seen);
+      } catch (const TestFailed& e) {
+        std::cout << "Validation failed (" << impl.name << "): v = " << u << "\n"
+                  << e.what() << std::endl;
+        throw;
+      }
+
+      size_t edges = 0;
+      for (Vertex v : G) if (P[v] != NO_VERTEX) edges += G.degree(v);
+      if (!G.is_directed()) edges /= 2;  // listed at both endpoints
+      teps.push_back(edges / std::max(time.count(), 1e-9));
+    }
+
+    if (teps.empty()) continue;
+    std::sort(teps.begin(), teps.end());
+    std::cout << "  " << std::left << std::setw(16) << impl.name << std::right
+              << std::scientific << std::setprecision(3)
+              << " TEPS q1 " << quantile(teps, 0.25)
+              << "  median " << quantile(teps, 0.5)
+              << "  q3 " << quantile(teps, 0.75) << std::defaultfloat << std::endl;
+  }
+}
+
+// Up to `roots` random vertices of G that have an edge.
+std::vector<Vertex> bench_roots(const Graph& G, RandomGraphGenerator& rgg, size_t roots) {
+  std::vector<Vertex> sources;
+  for (size_t tries = 0; sources.size() < roots && tries < 100 * roots; tries++) {
+    Vertex u = rgg.vertex(G);
+    if (G.degree(u)) sources.push_back(u);
+  }
+  return sources;
+}
+
+// Builds one graph at a time and measures it as lists, then frozen in place
+// as CSR, from the same roots.
+void run_benchmarks(unsigned scale, size_t roots) {
+  RandomGraphGenerator rgg(53323);
+  const size_t n = size_t(1) << scale;
+  const size_t dense = std::sqrt(16.0 * n / 0.7);
+
+  for (std::string family : { "rmat", "graph1", "graph2" }) {
+    Graph G = family == "rmat" ? rgg.rmat(scale, 16)
+      : family == "graph1" ? rgg.graph1(n, 16 * n)
+      : rgg.graph2(dense, 0.7);
+    const std::vector<Vertex> sources = bench_roots(G, rgg, roots);
+
+    bench_graph(family.c_str(), G, sources);
+    G.freeze();
+    bench_graph((family + " (CSR)").c_str(), G, sources);
+  }
+}
+
+// Without arguments runs the tests, `--bench [scale] [roots]` runs the
+// benchmark on graphs with 2^scale vertices (default 16) from `roots`
+// random roots (default 16).
+int main(int argc, char **argv) {
+  try {
+    if (argc > 1 && std::string(argv[1]) == "--bench") {
+      run_benchmarks(argc > 2 ? std::stoul(argv[2]) : 16, argc > 3 ? std::stoul(argv[3]) : 16);
+      return 0;
+    }
+
     run_tests();
 
     std::cout << "All tests passed." << std::endl;
@@ -23,20 +23,39 @@
 
 #ifndef __PROGTEST__
 #include <cassert>
+#include <chrono>
+#include <ctime>
 #include <cstdarg>
 #include <iomanip>
 #include <cstdint>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <limits>
 #include <optional>
 #include <array>
+#include <atomic>
 #include <algorithm>
 #include <vector>
 #include <deque>
+#include <exception>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <system_error>
+#include <filesystem>
 #include <queue>
 #include <random>
+#include <span>
+#include <thread>
+#include <tuple>
 #include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
 
 
 struct TestFailed : std::runtime_error {
@@ -67,139 +86,318 @@ enum Vertex : size_t {
   ROOT = -size_t(2)
 };
 
-struct Graph {
-  Graph() : Graph(0) {}
-  explicit Graph(size_t vertices) : _adj(vertices) {}
-  Graph(const std::vector<std::vector<size_t>>& adj) : Graph(adj.size()) {
+// Half-width vertex IDs for graphs below 2^32 - 2 vertices. The in-degree
+// counters and the order over them take half the memory.
+enum Vertex32 : uint32_t {};
+
+template<typename V>
+struct BasicVertexIterator {
+  BasicVertexIterator() = default;
+  BasicVertexIterator(size_t v) : _v(v) {}
+
+  BasicVertexIterator& operator ++ () { _v++; return *this; }
+  V operator * () const { return V(_v); }
+
+  friend bool operator == (BasicVertexIterator a, BasicVertexIterator b) { return a._v == b._v; }
+  friend bool operator != (BasicVertexIterator a, BasicVertexIterator b) { return !(a == b); }
+
+  private:
+  size_t _v = NO_VERTEX;
+};
+
+using VertexIterator = BasicVertexIterator<Vertex>;
+
+// Checking policies of BasicGraph::operator []. The tests run with bounds
+// checks, NDEBUG builds get a plain lookup.
+struct CheckedAccess {
+  static void access(size_t v, size_t vertices) {
+    CHECK(v < vertices, "Graph: index %zu out of range [0..%zu).", v, vertices);
+  }
+};
+
+struct UncheckedAccess {
+  static void access(size_t, size_t) {}
+};
+
+// Lazily built transpose of a graph, see BasicGraph::transposed. Copies of
+// the graph share a transpose that is already built.
+template<typename GraphT>
+struct TransposeCache {
+  TransposeCache() = default;
+  TransposeCache(const TransposeCache& o) : _graph(o.get()) {}
+  TransposeCache& operator = (const TransposeCache& o) {
+    auto graph = o.get();
+    std::lock_guard guard(_lock);
+    _graph = std::move(graph);
+    return *this;
+  }
+
+  std::shared_ptr<const GraphT> get() const {
+    std::lock_guard guard(_lock);
+    return _graph;
+  }
+
+  template<typename Build>
+  const GraphT& get_or_build(Build build) const {
+    std::lock_guard guard(_lock);
+    if (!_graph) _graph = std::make_shared<const GraphT>(build());
+    return *_graph;
+  }
+
+  // Like any change of the graph, needs exclusive access.
+  void reset() { _graph.reset(); }
+
+  private:
+  mutable std::mutex _lock;
+  mutable std::shared_ptr<const GraphT> _graph;
+};
+
+template<typename Checks, typename V = Vertex>
+struct BasicGraph {
+  using vertex_type = V;
+
+  BasicGraph() : BasicGraph(0) {}
+  explicit BasicGraph(size_t vertices) : _adj(vertices) {}
+  BasicGraph(const std::vector<std::vector<size_t>>& adj) : BasicGraph(adj.size()) {
     for (size_t i = 0; i < adj.size(); i++)
-      for (size_t v : adj[i]) add_edge(Vertex{i}, Vertex{v});
+      for (size_t v : adj[i]) add_edge(V(i), V(v));
   }
 
-  size_t vertices() const { return _adj.size(); }
+  // Frozen graph over ready CSR arrays, targets[offsets[v]..offsets[v+1]) are
+  // the successors of v.
+  static BasicGraph from_csr(std::vector<size_t> offsets, std::vector<V> targets) {
+    auto csr = std::make_shared<const Csr>(Csr{ std::move(offsets), std::move(targets) });
+    return from_view(csr->offsets, csr->targets, csr);
+  }
 
-  void add_edge(Vertex u, Vertex v) {
+  // Frozen graph over CSR arrays owned by someone else, e.g. a mapped file.
+  // The graph and its copies keep `owner` alive.
+  static BasicGraph from_view(std::span<const size_t> offsets,
+                         std::span<const V> targets,
+                         std::shared_ptr<const void> owner) {
+    CHECK(!offsets.empty() && offsets.back() == targets.size(),
+      "Graph: CSR offsets do not match %zu targets.", targets.size());
+
+    BasicGraph ret;
+    ret._storage = std::move(owner);
+    ret._offsets = offsets;
+    ret._targets = targets;
+    return ret;
+  }
+
+  size_t vertices() const { return _storage ? _offsets.size() - 1 : _adj.size(); }
+  size_t edges() const { return _storage ? _targets.size() : count_edges(); }
+  bool is_frozen() const { return _storage != nullptr; }
+
+  // Raw CSR arrays of a frozen graph.
+  std::span<const size_t> csr_offsets() const { return _offsets; }
+  std::span<const V> csr_targets() const { return _targets; }
+
+  void add_edge(V u, V v) {
+    CHECK(!_storage, "Graph: add_edge on a frozen graph.");
     _adj[u].push_back(v);
+    _transpose.reset();
   }
 
-  const std::vector<Vertex>& operator [] (Vertex v) const {
-    CHECK(size_t(v) < _adj.size(),
-      "Graph: index %zu out of range [0..%zu).", size_t(v), _adj.size());
-    return _adj[v];
+  // Packs the adjacency lists into one offsets array and one contiguous
+  // target array (CSR). The graph becomes read-only, copies share the storage.
+  // A transpose built from the lists is dropped; the next one is CSR too.
+  void freeze() {
+    if (_storage) return;
+
+    auto csr = std::make_shared<Csr>();
+    csr->offsets.reserve(_adj.size() + 1);
+    csr->targets.reserve(count_edges());
+
+    csr->offsets.push_back(0);
+    for (const auto& list : _adj) {
+      csr->targets.insert(csr->targets.end(), list.begin(), list.end());
+      csr->offsets.push_back(csr->targets.size());
+    }
+
+    _offsets = csr->offsets;
+    _targets = csr->targets;
+    _storage = std::move(csr);
+    std::vector<std::vector<V>>().swap(_adj);
+    _transpose.reset();
   }
 
-  Graph reversed() const {
-    Graph ret(vertices());
-    for (Vertex v : *this) for (Vertex w : operator[](v))
-      ret.add_edge(w, v);
-    return ret;
+  std::span<const V> operator [] (V v) const {
+    Checks::access(v, vertices());
+    if (_storage) return _targets.subspan(_offsets[v], _offsets[v + 1] - _offsets[v]);
+    return _adj[v];
   }
-  
-  struct Iterator {
-    Iterator() = default;
 
-    Iterator& operator ++ () { _v++; return *this; }
-    Vertex operator * () const { return Vertex{_v}; }
+  // Frozen graphs are transposed by counting sort straight into CSR.
+  BasicGraph reversed() const {
+    if (!_storage) {
+      BasicGraph ret(vertices());
+      for (V v : *this) for (V w : operator[](v))
+        ret.add_edge(w, v);
+      return ret;
+    }
 
-    friend bool operator == (Iterator a, Iterator b) { return a._v == b._v; }
-    friend bool operator != (Iterator a, Iterator b) { return !(a == b); }
+    std::vector<size_t> offsets(vertices() + 1, 0);
+    std::vector<V> targets(edges());
 
-    private:
-    friend struct Graph;
-    Iterator(size_t v) : _v(v) {}
+    for (V w : _targets) offsets[w + 1]++;
+    for (size_t v = 0; v < vertices(); v++) offsets[v + 1] += offsets[v];
 
-    size_t _v = NO_VERTEX;
-  };
+    std::vector<size_t> pos(offsets.begin(), offsets.end() - 1);
+    for (V v : *this) for (V w : operator[](v))
+      targets[pos[w]++] = v;
+
+    return from_csr(std::move(offsets), std::move(targets));
+  }
+
+  // reversed() built on first use and kept until the next add_edge, so that
+  // repeated callers share one transpose. Valid while the graph is alive and
+  // unchanged.
+  const BasicGraph& transposed() const {
+    return _transpose.get_or_build([this] { return reversed(); });
+  }
+  
+  using Iterator = BasicVertexIterator<V>;
 
   Iterator begin() const { return { 0 }; }
   Iterator end() const { return { vertices() }; }
 
   private:
-  std::vector<std::vector<Vertex>> _adj;
+  struct Csr {
+    std::vector<size_t> offsets;
+    std::vector<V> targets;
+  };
+
+  size_t count_edges() const {
+    size_t m = 0;
+    for (const auto& list : _adj) m += list.size();
+    return m;
+  }
+
+  std::vector<std::vector<V>> _adj;
+  std::shared_ptr<const void> _storage;  // owner of the CSR arrays once frozen
+  std::span<const size_t> _offsets;
+  std::span<const V> _targets;
+  TransposeCache<BasicGraph> _transpose;
 };
 
-std::ostream& operator << (std::ostream& out, const Graph& G) {
+template<typename Checks, typename V>
+std::ostream& operator << (std::ostream& out, const BasicGraph<Checks, V>& G) {
   out << "{{ ";
-  for (Vertex v : G) {
+  for (V v : G) {
     out << "{";
-    for (Vertex w : G[v]) out << w << ",";
+    for (V w : G[v]) out << w << ",";
     out << "}, ";
   }
   return out << "}}";
 }
 
+#ifdef NDEBUG
+using GraphChecks = UncheckedAccess;
+#else
+using GraphChecks = CheckedAccess;
 #endif
 
-//   is_cyclic, in_cycle
-void dfs(
-        const Graph &G_,
-        Vertex start,
-        std::vector<Vertex> &cycle,
-        std::vector<bool> &visiting,
-        const std::vector<size_t> &in_count) {
-    std::vector<std::vector<Vertex>> graph(G_.vertices());
+using Graph = BasicGraph<GraphChecks>;
+using Graph32 = BasicGraph<GraphChecks, Vertex32>;
 
-    for(auto v: G_) {
-        graph[v] = G_[v];
-    }
+#endif
 
-    std::vector<Vertex> stack;
-    stack.push_back(start);
-    visiting[start] = true;
+// Finds a cycle among the vertices left with in_count > 0, i.e. those Kahn's
+// algorithm could not sort, by a DFS from start over the transposed graph.
+// The graph is only read: every vertex on the path keeps a cursor into its
+// own neighbor list and sorted vertices are never entered. As each such
+// vertex has an unsorted predecessor the walk cannot get stuck, so the cost
+// is the adjacency of the path, not of the graph. The cycle is returned in
+// the order of G_.
+template<typename GraphT, typename V, typename Count>
+void dfs(
+        const GraphT &G_,
+        V start,
+        std::vector<V> &cycle,
+        std::vector<bool> &visiting,
+        const std::vector<Count> &in_count) {
+    using Neighbors = decltype(G_[start]);
+    struct Frame {
+        V v;
+        decltype(std::declval<Neighbors>().begin()) next;
+        decltype(std::declval<Neighbors>().end()) end;
+    };
+
+    std::vector<Frame> stack;
+    auto enter = [&](V v) {
+        const auto &neighbors = G_[v];
+        stack.push_back({ v, neighbors.begin(), neighbors.end() });
+        visiting[v] = true;
+    };
+    enter(start);
 
-    bool cyclic = false;
     while(!stack.empty()) {
-        Vertex curr = stack.back();
-
-        if(cyclic) {
-            if(curr == cycle[0]) {
-                std::reverse(cycle.begin(), cycle.end());
-                return;
-            }
-            cycle.push_back(curr);
-            stack.pop_back();
-            continue;
-        }
-
-        if(graph[curr].empty()) {
+        auto &top = stack.back();
+        if(top.next == top.end) {
+            visiting[top.v] = false;
             stack.pop_back();
-            visiting[curr] = false;
             continue;
         }
-        const auto next = graph[curr].back(); graph[curr].pop_back();
+        const V next = *top.next; ++top.next;
 
         if(in_count[next] == 0)
             continue;
 
-        if(visiting[next]) {
-            cyclic = true;
-            cycle.push_back(next);
+        if(!visiting[next]) {
+            enter(next);
             continue;
         }
 
-        visiting[next] = true;
-        stack.push_back(next);
+        size_t i = stack.size();
+        while(stack[--i].v != next);
+        for(; i < stack.size(); i++) cycle.push_back(stack[i].v);
+        return;
     }
 }
 
 
-// Returns either true and a topological order or false and a cycle
-std::pair<bool, std::vector<Vertex>> topsort(const Graph& G) {
-    const auto RG = G.reversed();
+// Vertex type of a graph, whatever its iterator yields.
+template<typename GraphT>
+using vertex_of = std::remove_cvref_t<decltype(*std::declval<const GraphT&>().begin())>;
+
+// In-degrees of all vertices in one pass over the successor lists.
+template<typename Count, typename GraphT>
+std::vector<Count> in_degrees(const GraphT& G) {
+    std::vector<Count> degree(G.vertices(), 0);
+    for(const auto v: G)
+        for(const auto w: G[v]) degree[w]++;
+    return degree;
+}
+
+// The cached transpose of graphs that keep one, a fresh one otherwise.
+template<typename GraphT>
+decltype(auto) transpose_of(const GraphT& G) {
+    if constexpr(requires { G.transposed(); }) return G.transposed();
+    else return G.reversed();
+}
+
+// Returns either true and a topological order or false and a cycle.
+// Works on any graph type with the Graph interface, e.g. CompressedGraph,
+// and any vertex type, e.g. Graph32 with 32-bit in-degree counters.
+// The transpose is needed only to extract a cycle.
+template<typename GraphT, typename V = vertex_of<GraphT>>
+std::pair<bool, std::vector<V>> topsort(const GraphT& G) {
     size_t n = G.vertices();
     std::vector<bool> visited(n);
-    std::vector<Vertex> q;
+    std::vector<V> q;
 
-    std::vector<size_t> cnt_incoming(n);
-    for(const auto from: RG) {
-        if((cnt_incoming[from] = RG[from].size()) == 0) {
-            q.push_back(from);
+    auto cnt_incoming = in_degrees<std::underlying_type_t<V>>(G);
+    for(const auto v: G) {
+        if(cnt_incoming[v] == 0) {
+            q.push_back(v);
         }
     }
 
-    std::vector<Vertex> global_order;
+    std::vector<V> global_order;
 
     while(!q.empty()) {
-        Vertex v = q.back(); q.pop_back();
+        V v = q.back(); q.pop_back();
         global_order.push_back(v);
         visited[v] = true;
 
@@ -215,6 +413,7 @@ std::pair<bool, std::vector<Vertex>> topsort(const Graph& G) {
             continue;
 
         global_order.clear();
+        const auto &RG = transpose_of(G);
         dfs(RG, v, global_order, visited, cnt_incoming);
 
         std::reverse(global_order.begin(), global_order.end());
@@ -225,6 +424,675 @@ std::pair<bool, std::vector<Vertex>> topsort(const Graph& G) {
 }
 
 
+// Returns either true and the topological order split into levels or false
+// and a cycle as the only level. Level 0 are the sources, level i + 1 the
+// vertices whose predecessors all lie in levels up to i, so no edge joins
+// two vertices of one level and each level can be processed in parallel.
+template<typename GraphT, typename V = vertex_of<GraphT>>
+std::pair<bool, std::vector<std::vector<V>>> topsort_levels(const GraphT& G) {
+    auto cnt_incoming = in_degrees<std::underlying_type_t<V>>(G);
+    std::vector<std::vector<V>> levels(1);
+    for(const auto v: G)
+        if(cnt_incoming[v] == 0) levels[0].push_back(v);
+
+    size_t sorted = 0;
+    while(!levels.back().empty()) {
+        std::vector<V> next;
+        for(const auto v: levels.back())
+            for(const auto ngb: G[v])
+                if(--cnt_incoming[ngb] == 0) next.push_back(ngb);
+
+        sorted += levels.back().size();
+        levels.push_back(std::move(next));
+    }
+    levels.pop_back();
+
+    if(sorted == G.vertices()) return {true, levels};
+
+    std::vector<bool> visiting(G.vertices());
+    for(const auto v: G) {
+        if(cnt_incoming[v] == 0)
+            continue;
+
+        std::vector<V> cycle;
+        dfs(transpose_of(G), v, cycle, visiting, cnt_incoming);
+
+        std::reverse(cycle.begin(), cycle.end());
+        return {false, {cycle}};
+    }
+
+    return {true, levels};
+}
+
+
+// Vertices a worker of execute_dag offers to the others. The ready vertices
+// of a worker live in its private stack; whenever this queue runs dry and the
+// stack holds more than one vertex, half of them move here.
+struct alignas(64) ReadyQueue {
+    std::mutex lock;
+    std::deque<Vertex> ready;
+    std::atomic<size_t> size{0};  // read without the lock to skip empty queues
+};
+
+// Per-vertex word of execute_dag: the number of predecessors not yet run in
+// the low half, the level (longest path from a source) in the high half.
+using DagState = std::vector<uint64_t>;
+constexpr uint64_t DAG_COUNT_MASK = (uint64_t(1) << 32) - 1;
+
+// Runs task(v) for every vertex on `threads` workers, each only after the
+// tasks of all predecessors of v have returned. A task taking (v, worker)
+// also gets the index of the worker running it, below `threads`.
+// In-degrees are counted and decremented atomically, together with raising
+// the successor's level. A worker pops its own ready vertices without
+// locking and shares them only through its ReadyQueue, idle workers steal
+// half of a queue at once. A worker shares before running each task, so a
+// long task never hides ready vertices from idle workers. The shared
+// `pending` counter (vertices in queues plus busy workers) changes only when
+// a worker shares, steals or runs out of work, and reaching zero ends the
+// run. Idle workers sleep on `wakeups` until vertices are shared, the run
+// ends or a task fails. Returns the number of tasks run,
+// less than G.vertices() iff G has a cycle; those on and behind cycles never
+// run, the others are left with their level in `state`. The first exception
+// thrown by a task stops the workers and is rethrown.
+template<typename Task>
+size_t execute_dag(const Graph &G, Task &&task, size_t threads, DagState &state) {
+    threads = std::max<size_t>(threads, 1);
+    const size_t n = G.vertices();
+    CHECK(n <= DAG_COUNT_MASK, "execute_dag: %zu vertices do not fit 32 bits.", n);
+    auto &cnt_incoming = state;
+    cnt_incoming.assign(n, 0);
+    const bool shared = threads > 1;  // a lone worker needs no atomics
+    std::vector<ReadyQueue> queues(threads);
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> ran{0};
+    std::atomic<bool> failed{false};
+    std::atomic<uint32_t> wakeups{0};
+    std::exception_ptr error;
+
+    auto wake_all = [&]() {
+        wakeups.fetch_add(1);
+        wakeups.notify_all();
+    };
+
+    auto run = [&](auto body) {
+        std::vector<std::thread> pool;
+        for(size_t id = 1; id < threads; id++)
+            pool.emplace_back(body, id);
+        body(0);
+        for(auto &t: pool) t.join();
+    };
+
+    run([&](size_t id) {
+        for(size_t v = n * id / threads; v < n * (id + 1) / threads; v++)
+            for(const auto w: G[Vertex{v}])
+                if(shared) std::atomic_ref<uint64_t>(cnt_incoming[w]).fetch_add(1, std::memory_order_relaxed);
+                else cnt_incoming[w]++;
+    });
+
+    for(size_t id = 0; id < threads; id++) {
+        auto &q = queues[id];
+        for(size_t v = n * id / threads; v < n * (id + 1) / threads; v++)
+            if(cnt_incoming[v] == 0) q.ready.push_back(Vertex{v});
+        q.size = q.ready.size();
+        pending += q.ready.size();
+    }
+
+    // Moves half of a queue, at least one vertex, to `local`.
+    auto steal = [&](ReadyQueue &q, std::vector<Vertex> &local) -> size_t {
+        std::lock_guard guard(q.lock);
+        const size_t k = (q.ready.size() + 1) / 2;
+        local.insert(local.end(), q.ready.begin(), q.ready.begin() + k);
+        q.ready.erase(q.ready.begin(), q.ready.begin() + k);
+        q.size.store(q.ready.size(), std::memory_order_relaxed);
+        return k;
+    };
+
+    run([&](size_t id) {
+        auto &mine = queues[id];
+        std::vector<Vertex> local;
+        size_t count = 0;
+
+        while(!failed.load(std::memory_order_relaxed)) {
+            if(local.empty()) {
+                // Read before looking for work, so that any later share or
+                // end of the run makes the wait below return at once.
+                const uint32_t seen = wakeups.load();
+
+                size_t got = 0;
+                for(size_t k = 0; k < threads && !got; k++) {
+                    auto &q = queues[(id + k) % threads];
+                    if(q.size.load(std::memory_order_relaxed)) got = steal(q, local);
+                }
+
+                if(!got) {
+                    // A task that failed after the check above has already
+                    // woken everyone and will never finish its share of
+                    // `pending`, so waiting for `seen` could block forever.
+                    if(failed.load() || pending.load(std::memory_order_acquire) == 0) break;
+                    wakeups.wait(seen);
+                    continue;
+                }
+                // `got` queued vertices become one busy worker.
+                pending.fetch_sub(got - 1, std::memory_order_relaxed);
+            }
+
+            const Vertex v = local.back(); local.pop_back();
+            if(shared && !local.empty() && mine.size.load(std::memory_order_relaxed) == 0) {
+                // Count the shared vertices before anyone can steal them.
+                const size_t k = (local.size() + 1) / 2;
+                pending.fetch_add(k, std::memory_order_relaxed);
+                {
+                    std::lock_guard guard(mine.lock);
+                    mine.ready.insert(mine.ready.end(), local.end() - k, local.end());
+                    mine.size.store(mine.ready.size(), std::memory_order_relaxed);
+                }
+                local.resize(local.size() - k);
+                wake_all();
+            }
+
+            try {
+                if constexpr(std::is_invocable_v<Task &, Vertex, size_t>) task(v, id);
+                else task(v);
+            } catch(...) {
+                if(!failed.exchange(true)) error = std::current_exception();
+                wake_all();
+                break;
+            }
+            count++;
+
+            const uint64_t level = (cnt_incoming[v] >> 32) + 1;
+            for(const auto w: G[v]) {
+                auto update = [level](uint64_t cur) {
+                    return std::max(cur >> 32, level) << 32 | ((cur & DAG_COUNT_MASK) - 1);
+                };
+
+                uint64_t next;
+                if(shared) {
+                    std::atomic_ref<uint64_t> word(cnt_incoming[w]);
+                    uint64_t cur = word.load(std::memory_order_relaxed);
+                    while(!word.compare_exchange_weak(cur, next = update(cur),
+                            std::memory_order_acq_rel, std::memory_order_relaxed));
+                } else {
+                    cnt_incoming[w] = next = update(cnt_incoming[w]);
+                }
+
+                if((next & DAG_COUNT_MASK) == 0)
+                    local.push_back(w);
+            }
+
+            if(local.empty() && pending.fetch_sub(1, std::memory_order_release) == 1)
+                wake_all();
+        }
+        ran.fetch_add(count, std::memory_order_relaxed);
+    });
+
+    if(error) std::rethrow_exception(error);
+    return ran;
+}
+
+template<typename Task>
+size_t execute_dag(const Graph &G, Task &&task,
+                   size_t threads = std::thread::hardware_concurrency()) {
+    DagState state;
+    return execute_dag(G, std::forward<Task>(task), threads, state);
+}
+
+// Same contract as topsort, parallel Kahn's algorithm on execute_dag. Each
+// worker records the vertices it ran in its own buffer; sorting them by the
+// levels execute_dag leaves behind gives the order, a lone worker's buffer
+// already is one. If some vertices are never ready, the cycle is extracted
+// serially as in topsort.
+std::pair<bool, std::vector<Vertex>> topsort_parallel(
+        const Graph &G, size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<size_t>(threads, 1);
+    const size_t n = G.vertices();
+    struct alignas(64) Buffer : std::vector<Vertex> {};
+    std::vector<Buffer> sorted(threads);
+    DagState state;
+
+    const size_t placed = execute_dag(G, [&](Vertex v, size_t worker) {
+        sorted[worker].push_back(v);
+    }, threads, state);
+
+    if(placed == n && threads == 1) return {true, std::move(sorted[0])};
+    if(placed == n) {
+        std::vector<size_t> start(n + 1, 0);
+        for(const auto &buffer: sorted)
+            for(const auto v: buffer) start[(state[v] >> 32) + 1]++;
+        for(size_t d = 0; d < n; d++) start[d + 1] += start[d];
+
+        std::vector<Vertex> order(n);
+        for(const auto &buffer: sorted)
+            for(const auto v: buffer) order[start[state[v] >> 32]++] = v;
+        return {true, order};
+    }
+
+    // Vertices left out are exactly those with an unsorted predecessor.
+    std::vector<size_t> unsorted(n, 1);
+    for(const auto &buffer: sorted)
+        for(const auto v: buffer) unsorted[v] = 0;
+
+    std::vector<bool> visiting(n);
+    for(const auto v: G) {
+        if(unsorted[v] == 0)
+            continue;
+
+        std::vector<Vertex> cycle;
+        dfs(G.transposed(), v, cycle, visiting, unsorted);
+
+        std::reverse(cycle.begin(), cycle.end());
+        return {false, cycle};
+    }
+
+    return {true, {}};
+}
+
+
+// Topological order of a growing DAG (Pearce-Kelly). An edge u -> v that
+// goes backwards in the order only affects the window between the positions
+// of v and u: the vertices reachable from v and those reaching u within it
+// are found by two bounded searches and swap places, all of the latter
+// ahead of all of the former, on the positions they occupied. An edge that
+// would close a cycle is not inserted and the cycle is reported instead.
+struct DynamicTopsort {
+    explicit DynamicTopsort(Graph &G)
+        : _G(G), _pred(G.vertices()), _pos(G.vertices()), _mark(G.vertices(), false) {
+        bool is_dag;
+        std::tie(is_dag, _order) = topsort(G);
+        CHECK(is_dag, "DynamicTopsort: initial graph has a cycle.");
+
+        for(size_t i = 0; i < _order.size(); i++) _pos[_order[i]] = i;
+        for(const auto v: G)
+            for(const auto w: G[v]) _pred[w].push_back(v);
+    }
+
+    // Inserts u -> v and returns nothing, or leaves the graph unchanged and
+    // returns the cycle v ... u the edge would close.
+    std::optional<std::vector<Vertex>> add_edge(Vertex u, Vertex v) {
+        if(_pos[u] > _pos[v]) {
+            const size_t lower = _pos[v], upper = _pos[u];
+
+            std::vector<Vertex> forward, backward, cycle;
+            if(search(v, u, upper, forward, cycle))
+                return cycle;
+
+            search_back(u, lower, backward);
+            reorder(forward, backward);
+        } else if(u == v) {
+            return std::vector<Vertex>{u};
+        }
+
+        _G.add_edge(u, v);
+        _pred[v].push_back(u);
+        return std::nullopt;
+    }
+
+    const std::vector<Vertex> &order() const { return _order; }
+    size_t position(Vertex v) const { return _pos[v]; }
+
+  private:
+    // DFS from v over successors at positions up to `upper`, collecting them
+    // in `visited`. On reaching `target` fills `path` with the path from v and
+    // returns true.
+    bool search(Vertex v, Vertex target, size_t upper,
+                std::vector<Vertex> &visited, std::vector<Vertex> &path) {
+        std::vector<std::pair<Vertex, size_t>> stack{{v, 0}};
+        _mark[v] = true;
+        visited.push_back(v);
+
+        bool found = false;
+        while(!stack.empty() && !found) {
+            auto &[x, next] = stack.back();
+            const auto succ = _G[x];
+            if(next == succ.size()) {
+                stack.pop_back();
+                continue;
+            }
+
+            const Vertex y = succ[next++];
+            if(y == target) {
+                found = true;
+                for(const auto &frame: stack) path.push_back(frame.first);
+                path.push_back(target);
+            } else if(!_mark[y] && _pos[y] < upper) {
+                _mark[y] = true;
+                visited.push_back(y);
+                stack.emplace_back(y, 0);
+            }
+        }
+
+        for(const auto x: visited) _mark[x] = false;
+        return found;
+    }
+
+    // DFS from u over predecessors at positions above `lower`.
+    void search_back(Vertex u, size_t lower, std::vector<Vertex> &visited) {
+        std::vector<Vertex> stack{u};
+        _mark[u] = true;
+        visited.push_back(u);
+
+        while(!stack.empty()) {
+            const Vertex x = stack.back(); stack.pop_back();
+            for(const auto y: _pred[x]) {
+                if(_mark[y] || _pos[y] <= lower) continue;
+                _mark[y] = true;
+                visited.push_back(y);
+                stack.push_back(y);
+            }
+        }
+
+        for(const auto x: visited) _mark[x] = false;
+    }
+
+    // Backward vertices first, then forward ones, each group in its current
+    // relative order, on the union of the positions they hold.
+    void reorder(std::vector<Vertex> &forward, std::vector<Vertex> &backward) {
+        auto by_pos = [&](Vertex a, Vertex b) { return _pos[a] < _pos[b]; };
+        std::sort(forward.begin(), forward.end(), by_pos);
+        std::sort(backward.begin(), backward.end(), by_pos);
+
+        std::vector<size_t> slots;
+        for(const auto x: backward) slots.push_back(_pos[x]);
+        for(const auto x: forward) slots.push_back(_pos[x]);
+        std::sort(slots.begin(), slots.end());
+
+        size_t i = 0;
+        for(const auto group: { &backward, &forward })
+            for(const auto x: *group) {
+                _pos[x] = slots[i++];
+                _order[_pos[x]] = x;
+            }
+    }
+
+    Graph &_G;
+    std::vector<std::vector<Vertex>> _pred;
+    std::vector<Vertex> _order;
+    std::vector<size_t> _pos;
+    std::vector<bool> _mark;
+};
+
+
+// Vertex permutation for locality, new_id[old] and its inverse old_id[new].
+struct Relabeling {
+    std::vector<Vertex> new_id;
+    std::vector<Vertex> old_id;
+};
+
+// Vertices in the order of a BFS over successors restarted from every yet
+// unvisited vertex, so successors mostly get IDs close to their predecessors.
+Relabeling bfs_order(const Graph &G) {
+    std::vector<bool> visited(G.vertices());
+    std::vector<Vertex> order;
+    order.reserve(G.vertices());
+
+    for(auto start: G) {
+        if(visited[start]) continue;
+
+        visited[start] = true;
+        order.push_back(start);
+        for(size_t head = order.size() - 1; head < order.size(); head++)
+            for(auto ngb: G[order[head]])
+                if(!visited[ngb]) {
+                    visited[ngb] = true;
+                    order.push_back(ngb);
+                }
+    }
+
+    std::vector<Vertex> new_id(order.size());
+    for(size_t i = 0; i < order.size(); i++)
+        new_id[order[i]] = Vertex{i};
+    return {std::move(new_id), std::move(order)};
+}
+
+// Frozen copy of G with vertex v renamed to r.new_id[v] and sorted successor
+// lists, built once and amortized over many traversals.
+Graph relabel(const Graph &G, const Relabeling &r) {
+    std::vector<size_t> offsets(G.vertices() + 1, 0);
+    std::vector<Vertex> targets;
+    targets.reserve(G.edges());
+
+    for(size_t i = 0; i < G.vertices(); i++) {
+        const auto begin = targets.size();
+        for(auto ngb: G[r.old_id[i]])
+            targets.push_back(r.new_id[ngb]);
+
+        std::sort(targets.begin() + begin, targets.end());
+        offsets[i + 1] = targets.size();
+    }
+
+    return Graph::from_csr(std::move(offsets), std::move(targets));
+}
+
+// Translates a topological order or a cycle of relabel(G, r) back to the
+// original vertex IDs.
+void restore_labels(const Relabeling &r, std::vector<Vertex> &vertices) {
+    for(auto &v: vertices)
+        v = r.old_id[v];
+}
+
+
+// LEB128 varints, 7 bits per byte, high bit set on all but the last byte.
+void write_varint(std::vector<uint8_t> &out, size_t value) {
+    while(value >= 0x80) {
+        out.push_back(uint8_t(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+inline size_t read_varint(const uint8_t *&in) {
+    size_t value = *in & 0x7f;
+    for(unsigned shift = 7; *in++ & 0x80; shift += 7)
+        value |= size_t(*in & 0x7f) << shift;
+    return value;
+}
+
+// Read-only graph with every successor list sorted and stored as varints:
+// the degree, the first successor relative to the vertex itself (zigzag
+// encoded) and then the gaps between consecutive successors. Has the Graph
+// interface, so topsort runs on it directly.
+struct CompressedGraph {
+    struct NeighborIterator {
+        Vertex operator * () const { return Vertex{_cur}; }
+        NeighborIterator& operator ++ () {
+            if(--_left) _cur += read_varint(_pos);
+            return *this;
+        }
+
+        friend bool operator == (const NeighborIterator &it, std::default_sentinel_t) {
+            return it._left == 0;
+        }
+
+        const uint8_t *_pos;
+        size_t _left;
+        size_t _cur;
+    };
+
+    struct Neighbors {
+        NeighborIterator begin() const {
+            const uint8_t *pos = _pos;
+            const size_t degree = read_varint(pos);
+            if(degree == 0) return {pos, 0, 0};
+
+            const size_t first = read_varint(pos);
+            const size_t delta = first & 1 ? ~(first >> 1) : first >> 1;
+            return {pos, degree, _v + delta};
+        }
+        std::default_sentinel_t end() const { return {}; }
+
+        size_t size() const {
+            const uint8_t *pos = _pos;
+            return read_varint(pos);
+        }
+        bool empty() const { return size() == 0; }
+
+        const uint8_t *_pos;
+        size_t _v;
+    };
+
+    CompressedGraph() = default;
+    explicit CompressedGraph(const Graph &G) {
+        _offsets.reserve(G.vertices() + 1);
+        std::vector<Vertex> list;
+
+        for(auto v: G) {
+            _offsets.push_back(_bytes.size());
+            auto succs = G[v];
+            list.assign(succs.begin(), succs.end());
+            std::sort(list.begin(), list.end());
+
+            write_varint(_bytes, list.size());
+            if(list.empty()) continue;
+
+            const size_t delta = list[0] - size_t(v);
+            write_varint(_bytes, delta >> 63 ? ~(delta << 1) : delta << 1);
+            for(size_t i = 1; i < list.size(); i++)
+                write_varint(_bytes, list[i] - list[i - 1]);
+        }
+
+        _offsets.push_back(_bytes.size());
+        _bytes.shrink_to_fit();
+    }
+
+    size_t vertices() const { return _offsets.empty() ? 0 : _offsets.size() - 1; }
+    size_t bytes() const { return _bytes.size() + _offsets.size() * sizeof(size_t); }
+
+    Neighbors operator [] (Vertex v) const {
+        CHECK(size_t(v) < vertices(),
+          "CompressedGraph: index %zu out of range [0..%zu).", size_t(v), vertices());
+        return {_bytes.data() + _offsets[v], v};
+    }
+
+    CompressedGraph reversed() const {
+        Graph ret(vertices());
+        for(auto v: *this) for(auto w: operator[](v))
+            ret.add_edge(w, v);
+        return CompressedGraph(ret);
+    }
+
+    VertexIterator begin() const { return { 0 }; }
+    VertexIterator end() const { return { vertices() }; }
+
+  private:
+    std::vector<size_t> _offsets;
+    std::vector<uint8_t> _bytes;
+};
+
+
+// On-disk CSR graph in native byte order: GraphFileHeader, offsets[vertices
+// + 1], targets[edges] and, with GRAPH_FILE_REVERSE, the same two arrays of
+// the transposed graph. Every section consists of 8-byte words, so a mapped
+// file is served in place and shared between processes via the page cache.
+struct GraphFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t vertices;
+    uint64_t edges;
+};
+
+constexpr char GRAPH_FILE_MAGIC[8] = {'A', 'G', '1', 'C', 'S', 'R', 0, 0};
+constexpr uint32_t GRAPH_FILE_VERSION = 1;
+enum : uint32_t { GRAPH_FILE_DIRECTED = 1, GRAPH_FILE_REVERSE = 2 };
+
+static_assert(sizeof(Vertex) == sizeof(uint64_t) && sizeof(size_t) == sizeof(uint64_t));
+
+void write_csr(std::ofstream &out, const Graph &G) {
+    auto offsets = G.csr_offsets();
+    auto targets = G.csr_targets();
+    out.write(reinterpret_cast<const char *>(offsets.data()), offsets.size_bytes());
+    out.write(reinterpret_cast<const char *>(targets.data()), targets.size_bytes());
+}
+
+// Writes G to path, with its transpose if with_reverse is set.
+void save_graph(const Graph &G, const std::string &path, bool with_reverse = false) {
+    Graph frozen = G;
+    frozen.freeze();
+
+    GraphFileHeader header{};
+    std::memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof header.magic);
+    header.version = GRAPH_FILE_VERSION;
+    header.flags = GRAPH_FILE_DIRECTED;
+    header.vertices = frozen.vertices();
+    header.edges = frozen.edges();
+    if(with_reverse) header.flags |= GRAPH_FILE_REVERSE;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof header);
+    write_csr(out, frozen);
+    if(header.flags & GRAPH_FILE_REVERSE)
+        write_csr(out, frozen.reversed());
+
+    if(!out.flush())
+        throw std::runtime_error("save_graph: cannot write " + path);
+}
+
+struct MappedGraph {
+    Graph graph;
+    std::optional<Graph> reversed;  // if the file stores the transpose
+};
+
+// Maps a file written by save_graph read-only. Nothing is copied and only
+// the header and the ends of the offsets array are checked, so opening is
+// O(1). For untrusted files pass verify to also scan the CSR arrays once,
+// so that a corrupt file throws instead of yielding a graph that reads
+// outside the mapping. The mapping lives as long as any graph using it.
+MappedGraph map_graph(const std::string &path, bool verify = false) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::system_error(errno, std::generic_category(), "map_graph: " + path);
+
+    struct stat st{};
+    if(fstat(fd, &st) < 0) {
+        const int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "map_graph: " + path);
+    }
+
+    const size_t size = st.st_size;
+    void *addr = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    const int err = errno;
+    close(fd);
+    if(addr == MAP_FAILED)
+        throw std::system_error(size ? err : EINVAL, std::generic_category(), "map_graph: " + path);
+
+    std::shared_ptr<const void> mapping(addr, [size](const void *p) {
+        munmap(const_cast<void *>(p), size);
+    });
+
+    const auto *header = static_cast<const GraphFileHeader *>(addr);
+    if(size < sizeof *header || std::memcmp(header->magic, GRAPH_FILE_MAGIC, sizeof header->magic)
+       || header->version != GRAPH_FILE_VERSION)
+        throw std::runtime_error("map_graph: " + path + " is not a graph file");
+
+    const size_t n = header->vertices, m = header->edges;
+    const size_t sections = header->flags & GRAPH_FILE_REVERSE ? 2 : 1;
+    const size_t capacity = (size - sizeof *header) / sizeof(uint64_t);
+    if(n >= capacity || m > capacity
+       || size != sizeof *header + sections * (n + 1 + m) * sizeof(uint64_t))
+        throw std::runtime_error("map_graph: " + path + " is truncated");
+
+    auto words = reinterpret_cast<const size_t *>(header + 1);
+    auto section = [&]() {
+        std::span<const size_t> offsets(words, n + 1);
+        std::span<const Vertex> targets(reinterpret_cast<const Vertex *>(words + n + 1), m);
+        words += n + 1 + m;
+
+        bool valid = offsets[0] == 0 && offsets[n] == m;
+        for(size_t v = 0; verify && valid && v < n; v++) valid = offsets[v] <= offsets[v + 1];
+        for(size_t i = 0; verify && valid && i < m; i++) valid = targets[i] < n;
+        if(!valid)
+            throw std::runtime_error("map_graph: " + path + " has corrupt CSR arrays");
+
+        return Graph::from_view(offsets, targets, mapping);
+    };
+
+    MappedGraph ret{section(), std::nullopt};
+    if(sections == 2) ret.reversed = section();
+    return ret;
+}
+
+
 #ifndef __PROGTEST__
 
 const Graph SMALL_DAGS[] = {
@@ -316,8 +1184,55 @@ void verify_cycle(const Graph& G, const std::vector<Vertex>& cycle) {
     "Missing edge from vertex %zu to vertex %zu.", size_t(cycle[i-1]), size_t(cycle[i]));
 }
 
-void test_topsort_inner(const Graph& G) {
-  auto [ is_dag, data ] = topsort(G);
+// Copy of G over 32-bit IDs, frozen iff G is.
+Graph32 to_graph32(const Graph& G) {
+  Graph32 H(G.vertices());
+  for (Vertex u : G) for (Vertex v : G[u]) H.add_edge(Vertex32(u), Vertex32(v));
+  if (G.is_frozen()) H.freeze();
+  return H;
+}
+
+using TopsortImpl = std::pair<bool, std::vector<Vertex>> (*)(const Graph&);
+
+struct TopsortVariant {
+  const char *name;
+  TopsortImpl run;
+};
+
+const TopsortVariant TOPSORT_VARIANTS[] = {
+  { "topsort", topsort<Graph> },
+  { "CompressedGraph", [](const Graph& G) { return topsort(CompressedGraph(G)); } },
+  { "bfs_order", [](const Graph& G) {
+      Relabeling r = bfs_order(G);
+      auto result = topsort(relabel(G, r));
+      restore_labels(r, result.second);
+      return result;
+    } },
+  { "topsort_parallel", [](const Graph& G) { return topsort_parallel(G, 4); } },
+  { "topsort_parallel(1)", [](const Graph& G) { return topsort_parallel(G, 1); } },
+  { "topsort_levels", [](const Graph& G) {
+      auto [ is_dag, levels ] = topsort_levels(G);
+      std::vector<Vertex> order;
+      std::vector<size_t> level(G.vertices());
+      for (size_t i = 0; i < levels.size(); i++) for (Vertex v : levels[i]) {
+        level[v] = i;
+        order.push_back(v);
+      }
+
+      if (is_dag) for (Vertex v : G) for (Vertex w : G[v]) CHECK(level[v] < level[w],
+        "Edge %zu --> %zu does not go to a later level.", size_t(v), size_t(w));
+      return std::pair(is_dag, order);
+    } },
+  { "Graph32", [](const Graph& G) {
+      auto [ is_dag, order32 ] = topsort(to_graph32(G));
+      std::vector<Vertex> order;
+      for (Vertex32 v : order32) order.push_back(Vertex{v});
+      return std::pair(is_dag, order);
+    } },
+};
+
+void test_topsort_inner(const Graph& G, const TopsortVariant& impl) {
+  auto [ is_dag, data ] = impl.run(G);
   // std::cout << is_dag;
 
   std::vector<bool> seen(G.vertices(), false);
@@ -334,15 +1249,242 @@ void test_topsort_inner(const Graph& G) {
 }
 
 void test_topsort(const Graph& G) {
+  Graph F = G;
+  F.freeze();
+
+  for (const Graph* H : { &G, &std::as_const(F) })
+    for (const TopsortVariant& impl : TOPSORT_VARIANTS) try {
+      test_topsort_inner(*H, impl);
+    } catch (const TestFailed& e) {
+      std::cout << "Test failed (" << impl.name << "): G = " << *H << "\n"
+                << e.what() << std::endl;
+      throw;
+    }
+}
+
+
+void test_mapped_graph(const Graph& G) {
+  const auto path = std::filesystem::temp_directory_path() / "ag1_topsort_test.graph";
+  save_graph(G, path, true);
+  MappedGraph mapped = map_graph(path, true);
+  std::filesystem::remove(path);
+
+  try {
+    CHECK(mapped.graph.is_frozen() && mapped.reversed.has_value(),
+      "Mapped graph is not frozen or lacks its transpose.");
+    CHECK(mapped.graph.vertices() == G.vertices() && mapped.graph.edges() == G.edges(),
+      "Mapped graph has %zu vertices and %zu edges instead of %zu and %zu.",
+      mapped.graph.vertices(), mapped.graph.edges(), G.vertices(), G.edges());
+
+    Graph RG = G.reversed();
+    for (Vertex v : G) {
+      auto a = G[v], b = mapped.graph[v];
+      CHECK(std::equal(a.begin(), a.end(), b.begin(), b.end()),
+        "Mapped graph has different successors of %zu.", size_t(v));
+      auto ra = RG[v], rb = (*mapped.reversed)[v];
+      CHECK(std::equal(ra.begin(), ra.end(), rb.begin(), rb.end()),
+        "Mapped transpose has different successors of %zu.", size_t(v));
+    }
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (map_graph): G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+
+  test_topsort(mapped.graph);
+}
+
+void test_transposed(Graph G) {
   try {
-    test_topsort_inner(G);
+    const Graph& T = G.transposed();
+    CHECK(&G.transposed() == &T, "Transpose was built twice.");
+
+    Graph RG = G.reversed();
+    CHECK(T.edges() == G.edges(), "Transpose has %zu edges instead of %zu.",
+      T.edges(), G.edges());
+    for (Vertex v : G) {
+      auto a = RG[v], b = T[v];
+      CHECK(std::equal(a.begin(), a.end(), b.begin(), b.end()),
+        "Transpose has different successors of %zu.", size_t(v));
+    }
+
+    Graph F = G;
+    CHECK(&F.transposed() == &T, "Copy does not share the transpose.");
+
+    G.add_edge(Vertex{0}, Vertex{1});
+    CHECK(G.transposed().edges() == F.edges() + 1,
+      "Transpose was not rebuilt after add_edge.");
+    CHECK(&F.transposed() == &T, "add_edge changed the transpose of a copy.");
+
+    G.freeze();
+    CHECK(G.transposed().is_frozen(), "Transpose was not rebuilt after freeze.");
   } catch (const TestFailed& e) {
-    std::cout << "Test failed: G = " << G << "\n"
-              << e.what() << std::endl;
+    std::cout << "Test failed (transposed): G = " << G << "\n" << e.what() << std::endl;
     throw;
   }
 }
 
+// While one long task runs, the other workers must sleep rather than spin.
+void test_execute_dag_idle() {
+  const Graph G({ {1}, {} });
+  const auto task_time = std::chrono::milliseconds(100);
+
+  const std::clock_t cpu = std::clock();
+  execute_dag(G, [&](Vertex v) { if (v == 0) std::this_thread::sleep_for(task_time); }, 4);
+  const double cpu_ms = 1000.0 * (std::clock() - cpu) / CLOCKS_PER_SEC;
+
+  try {
+    CHECK(cpu_ms < task_time.count() / 2.0,
+      "Idle workers used %.1f ms of CPU during a %d ms task.", cpu_ms, int(task_time.count()));
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (execute_dag): " << e.what() << std::endl;
+    throw;
+  }
+}
+
+// A task failing while other workers go idle must stop all of them. Shares
+// keep waking the idle workers, so some are about to wait when it happens.
+void test_execute_dag_failure() {
+  const size_t n = 255;
+  Graph G(n);
+  for (size_t v = 0; 2*v + 2 < n; v++) {
+    G.add_edge(Vertex{v}, Vertex{2*v + 1});
+    G.add_edge(Vertex{v}, Vertex{2*v + 2});
+  }
+
+  try {
+    for (size_t i = 0; i < 500; i++) {
+      const Vertex bad{n/2 + i % (n/2)};
+      bool thrown = false;
+      try {
+        execute_dag(G, [&](Vertex v) { if (v == bad) throw std::runtime_error("task failed"); }, 4);
+      } catch (const std::runtime_error&) {
+        thrown = true;
+      }
+      CHECK(thrown, "Exception of task %zu was not propagated.", size_t(bad));
+    }
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (execute_dag): " << e.what() << std::endl;
+    throw;
+  }
+}
+
+void test_execute_dag(const Graph& G) {
+  const Graph& RG = G.transposed();
+  const bool is_dag = topsort(G).first;
+  std::vector<std::atomic<bool>> finished(G.vertices());
+
+  try {
+    size_t ran = execute_dag(G, [&](Vertex v) {
+      for (Vertex u : RG[v]) CHECK(finished[u].load(),
+        "Task %zu started before its predecessor %zu finished.", size_t(v), size_t(u));
+      finished[v] = true;
+    }, 4);
+    CHECK((ran == G.vertices()) == is_dag, "Ran %zu of %zu tasks, graph %s a DAG.",
+      ran, G.vertices(), is_dag ? "is" : "is not");
+
+    if (G.vertices() == 0) return;
+    bool thrown = false;
+    try {
+      execute_dag(G, [&](Vertex v) {
+        if (v == G.vertices() - 1) throw std::runtime_error("task failed");
+      }, 4);
+    } catch (const std::runtime_error&) {
+      thrown = true;
+    }
+    CHECK(thrown || !is_dag, "Exception of a task was not propagated.");
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (execute_dag): G = " << G << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+// Inserts random edges, mostly from lower to higher IDs, one at a time.
+void test_dynamic_topsort(RandomGraphGenerator& rgg, uint32_t n, size_t edges, bool check_each) {
+  Graph G(n), H(n);  // H gets the accepted edges independently
+  DynamicTopsort dyn(G);
+
+  try {
+    for (size_t e = 0; e < edges; e++) {
+      Vertex u = rgg.vertex(G), v = rgg.vertex(G);
+      if (u > v && rgg.num(100) < 97) std::swap(u, v);
+
+      auto cycle = dyn.add_edge(u, v);
+      if (!cycle) {
+        H.add_edge(u, v);
+        if (check_each) verify_toporder(H, dyn.order());
+        continue;
+      }
+
+      CHECK(cycle->front() == v && cycle->back() == u,
+        "Cycle closed by %zu -> %zu runs from %zu to %zu.",
+        size_t(u), size_t(v), size_t(cycle->front()), size_t(cycle->back()));
+      for (size_t i = 1; i < cycle->size(); i++) {
+        auto succ = H[(*cycle)[i-1]];
+        CHECK(std::find(succ.begin(), succ.end(), (*cycle)[i]) != succ.end(),
+          "Missing edge from vertex %zu to vertex %zu.",
+          size_t((*cycle)[i-1]), size_t((*cycle)[i]));
+      }
+    }
+
+    CHECK(G.edges() == H.edges(), "Graph has %zu edges instead of %zu.", G.edges(), H.edges());
+    verify_toporder(H, dyn.order());
+  } catch (const TestFailed& e) {
+    std::cout << "Test failed (DynamicTopsort): G = " << H << "\n" << e.what() << std::endl;
+    throw;
+  }
+}
+
+// map_graph must reject files whose header or CSR arrays are inconsistent.
+// The base file holds the path 0 -> 1 -> 2 -> 3 -> 4: a 32-byte header,
+// offsets at byte 32 and targets at byte 80.
+void test_corrupt_graph_files() {
+  const auto path = std::filesystem::temp_directory_path() / "ag1_topsort_corrupt.graph";
+  auto patch = [&](size_t pos, uint64_t value) {
+    save_graph(SMALL_DAGS[0], path);
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(pos);
+    f.write(reinterpret_cast<const char *>(&value), sizeof value);
+  };
+  auto rejected = [&]() {
+    try {
+      map_graph(path, true);
+    } catch (const TestFailed&) {
+      return false;
+    } catch (const std::runtime_error&) {
+      return true;
+    }
+    return false;
+  };
+
+  try {
+    {
+      // (n + 1) * 8 wraps around to the 32 bytes that follow the header.
+      GraphFileHeader header{};
+      std::memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof header.magic);
+      header.version = GRAPH_FILE_VERSION;
+      header.vertices = (uint64_t(1) << 61) + 3;
+      const uint64_t zeros[4] = {};
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(&header), sizeof header);
+      out.write(reinterpret_cast<const char *>(zeros), sizeof zeros);
+    }
+    CHECK(rejected(), "Overflowing vertex count was accepted.");
+
+    patch(32, 1);
+    CHECK(rejected(), "Nonzero first offset was accepted.");
+    patch(48, 4);
+    CHECK(rejected(), "Decreasing offsets were accepted.");
+    patch(80, 7);
+    CHECK(rejected(), "Target out of range was accepted.");
+    patch(80, 1);
+    CHECK(!rejected(), "Valid file was rejected.");
+  } catch (const TestFailed& e) {
+    std::filesystem::remove(path);
+    std::cout << "Test failed (map_graph): " << e.what() << std::endl;
+    throw;
+  }
+  std::filesystem::remove(path);
+}
 
 void run_tests() {
   std::cout << "Small DAGs..." << std::endl;
@@ -375,6 +1517,31 @@ void run_tests() {
   }
   std::cout << "Long cycle..." << std::endl;
   test_topsort(rgg.cycle(50'000));
+
+  std::cout << "Mapped graph files..." << std::endl;
+  test_corrupt_graph_files();
+  for (size_t i = 0; i < 4; i++)
+    test_mapped_graph(rgg.graph1(5'000 + 50*i, 20'000 + 50*i));
+
+  std::cout << "Cached transposes..." << std::endl;
+  for (size_t i = 0; i < 4; i++)
+    test_transposed(rgg.graph1(100 + 10*i, 300 + 10*i));
+
+  std::cout << "Dynamic topological order..." << std::endl;
+  for (size_t i = 0; i < 30; i++)
+    test_dynamic_topsort(rgg, 5 + i, 3*(5 + i), true);
+  for (size_t i = 0; i < 5; i++)
+    test_dynamic_topsort(rgg, 10'000 + 100*i, 30'000, false);
+
+  std::cout << "DAG task executor..." << std::endl;
+  for (const Graph& G : SMALL_DAGS)
+    test_execute_dag(G);
+  for (const Graph& G : SMALL_CYCLIC)
+    test_execute_dag(G);
+  for (size_t i = 0; i < 10; i++)
+    test_execute_dag(rgg.graph1(2'000 + 50*i, 6'000 + 50*i));
+  test_execute_dag_idle();
+  test_execute_dag_failure();
 }
 
 int main() {